@@ -5,11 +5,14 @@ layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+layout (std140) uniform Camera {   // filled once per frame, see CameraUniforms
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+};
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main() {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
 }
@@ -0,0 +1,18 @@
+﻿#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aModel;   // per instance, occupies locations 3..6
+
+out vec2 TexCoords;
+
+layout (std140) uniform Camera {   // filled once per frame, see CameraUniforms
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+};
+
+void main() {
+    TexCoords = aTexCoords;
+    gl_Position = viewProjection * aModel * vec4(aPos, 1.0);
+}
@@ -0,0 +1,2005 @@
+// Map colliders: floor BVH (+ optional heightfield), height-aware wall boxes in a uniform
+// grid, and the background rebuild when the map placement changes. No GL in here, so it
+// runs headless (see sim_benchmark.cpp).
+// Header-only: include it from one translation unit per executable.
+#ifndef MAP_COLLISION_H
+#define MAP_COLLISION_H
+
+#include "model_data.h"
+#include "profiler.h"
+#include "worker_pool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <limits>
+#include <memory>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// ---------- 2D AABB (XZ) ----------
+struct AABB2D { glm::vec2 center, halfExt; };
+static inline bool IntersectsXZ(const AABB2D& a, const AABB2D& b) {
+    if (std::abs(a.center.x - b.center.x) > (a.halfExt.x + b.halfExt.x)) return false;
+    if (std::abs(a.center.y - b.center.y) > (a.halfExt.y + b.halfExt.y)) return false;
+    return true;
+}
+static inline void ResolveStaticXZ(const AABB2D& statBox, AABB2D& dynBox, glm::vec3& posXZ) {
+    float dx = dynBox.center.x - statBox.center.x;
+    float dz = dynBox.center.y - statBox.center.y;
+    float px = (dynBox.halfExt.x + statBox.halfExt.x) - std::abs(dx);
+    float pz = (dynBox.halfExt.y + statBox.halfExt.y) - std::abs(dz);
+    if (px < 0 || pz < 0) return;
+    if (px < pz) { float sx = (dx < 0 ? -1.f : 1.f); posXZ.x += sx * px; dynBox.center.x += sx * px; }
+    else { float sz = (dz < 0 ? -1.f : 1.f); posXZ.z += sz * pz; dynBox.center.y += sz * pz; }
+}
+
+// ---------- Map placement ----------
+float MAP_Y_OFFSET = -20.0f;
+float MAP_SCALE = 1.0f;
+float MAP_YAW_DEG = 0.0f;
+
+// ---------- Map collision data ----------
+
+// Height-aware wall box
+struct WallBox {
+    AABB2D boxXZ;
+    float  minY, maxY;
+};
+
+// Solid wall rectangle for occlusion culling (see occlusion.h), corners in order around it
+struct Occluder { glm::vec3 v[4]; };
+
+std::vector<Occluder> gOccluders;
+
+struct MapPlacement {
+    float yOffset, scale, yawDeg;
+    bool SameShape(const MapPlacement& o) const { return scale == o.scale && yawDeg == o.yawDeg; }
+};
+MapPlacement CurrentMapPlacement() { return { MAP_Y_OFFSET, MAP_SCALE, MAP_YAW_DEG }; }
+
+glm::mat4 MapTransform(const MapPlacement& p) {
+    glm::mat4 M(1.0f);
+    M = glm::translate(M, glm::vec3(0.f, p.yOffset, 0.f));
+    M = glm::rotate(M, glm::radians(p.yawDeg), glm::vec3(0, 1, 0));
+    M = glm::scale(M, glm::vec3(p.scale));
+    return M;
+}
+glm::mat4 MapTransform() { return MapTransform(CurrentMapPlacement()); }
+
+// Möller–Trumbore
+bool RaycastTri(const glm::vec3& ro, const glm::vec3& rd, const Tri& tri, float& tHit) {
+    const float EPS = 1e-6f;
+    glm::vec3 v0v1 = tri.b - tri.a;
+    glm::vec3 v0v2 = tri.c - tri.a;
+    glm::vec3 pvec = glm::cross(rd, v0v2);
+    float det = glm::dot(v0v1, pvec);
+    if (fabs(det) < EPS) return false;
+    float invDet = 1.0f / det;
+
+    glm::vec3 tvec = ro - tri.a;
+    float u = glm::dot(tvec, pvec) * invDet; if (u < 0.0f || u > 1.0f) return false;
+    glm::vec3 qvec = glm::cross(tvec, v0v1);
+    float v = glm::dot(rd, qvec) * invDet;   if (v < 0.0f || (u + v) > 1.0f) return false;
+
+    float t = glm::dot(v0v2, qvec) * invDet; if (t <= 0.0f) return false;
+    tHit = t; return true;
+}
+
+// ---------- Triangle packets (SoA, SIMD) ----------
+// Same Möller–Trumbore test as RaycastTri, run on 4 (SSE) or 8 (AVX2) triangles
+// at once from a structure-of-arrays packet with precomputed edges. The kernel is
+// picked once at startup from the CPU features; every variant does the same float
+// operations in the same order, so all of them return bit-identical hits.
+struct RayHit { float t; int tri; };
+
+const int TRI_PACKET = 8;  // lanes per packet: one AVX2 register, two SSE ones
+
+// Filled from the compact floor store (CompactTris::Decode) right before the test.
+struct TriPacket {
+    alignas(32) float v0x[TRI_PACKET], v0y[TRI_PACKET], v0z[TRI_PACKET];
+    alignas(32) float e1x[TRI_PACKET], e1y[TRI_PACKET], e1z[TRI_PACKET];
+    alignas(32) float e2x[TRI_PACKET], e2y[TRI_PACKET], e2z[TRI_PACKET];
+    int id[TRI_PACKET];  // triangle index of each lane
+};
+
+// Nearest hit among lanes [0, count) with t <= best.t; equal t keeps the lowest id.
+using TriRangeKernel = void(*)(const TriPacket&, int count,
+                               const glm::vec3& ro, const glm::vec3& rd, RayHit& best);
+
+static inline void AcceptTriHit(RayHit& best, float t, int ti) {
+    if (t <= best.t && (t < best.t || best.tri < 0 || ti < best.tri)) { best.t = t; best.tri = ti; }
+}
+
+static void TriRangeScalar(const TriPacket& p, int count,
+                           const glm::vec3& ro, const glm::vec3& rd, RayHit& best)
+{
+    const float EPS = 1e-6f;
+    for (int i = 0; i < count; ++i) {
+        glm::vec3 e1(p.e1x[i], p.e1y[i], p.e1z[i]);
+        glm::vec3 e2(p.e2x[i], p.e2y[i], p.e2z[i]);
+        glm::vec3 pvec = glm::cross(rd, e2);
+        float det = glm::dot(e1, pvec);
+        if (fabs(det) < EPS) continue;
+        float invDet = 1.0f / det;
+
+        glm::vec3 tvec = ro - glm::vec3(p.v0x[i], p.v0y[i], p.v0z[i]);
+        float u = glm::dot(tvec, pvec) * invDet; if (u < 0.0f || u > 1.0f) continue;
+        glm::vec3 qvec = glm::cross(tvec, e1);
+        float v = glm::dot(rd, qvec) * invDet;   if (v < 0.0f || (u + v) > 1.0f) continue;
+
+        float t = glm::dot(e2, qvec) * invDet;   if (t <= 0.0f) continue;
+        AcceptTriHit(best, t, p.id[i]);
+    }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TRI_SIMD_X86 1
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Comparisons use the negated/unordered predicates so NaNs are rejected exactly
+// where the scalar early-outs reject them.
+static void TriRangeSSE(const TriPacket& p, int count,
+                        const glm::vec3& ro, const glm::vec3& rd, RayHit& best)
+{
+    const __m128 rdx = _mm_set1_ps(rd.x), rdy = _mm_set1_ps(rd.y), rdz = _mm_set1_ps(rd.z);
+    const __m128 rox = _mm_set1_ps(ro.x), roy = _mm_set1_ps(ro.y), roz = _mm_set1_ps(ro.z);
+    const __m128 eps = _mm_set1_ps(1e-6f), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    alignas(16) float tl[4];
+
+    for (int base = 0; base < count; base += 4) {
+        __m128 e1x = _mm_load_ps(p.e1x + base), e1y = _mm_load_ps(p.e1y + base), e1z = _mm_load_ps(p.e1z + base);
+        __m128 e2x = _mm_load_ps(p.e2x + base), e2y = _mm_load_ps(p.e2y + base), e2z = _mm_load_ps(p.e2z + base);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(rdy, e2z), _mm_mul_ps(rdz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(rdz, e2x), _mm_mul_ps(rdx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(rdx, e2y), _mm_mul_ps(rdy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 ok = _mm_cmpnlt_ps(_mm_and_ps(det, absMask), eps);
+        __m128 invDet = _mm_div_ps(one, det);
+
+        __m128 tx = _mm_sub_ps(rox, _mm_load_ps(p.v0x + base));
+        __m128 ty = _mm_sub_ps(roy, _mm_load_ps(p.v0y + base));
+        __m128 tz = _mm_sub_ps(roz, _mm_load_ps(p.v0z + base));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+        ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpnlt_ps(u, zero), _mm_cmpngt_ps(u, one)));
+
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rdx, qx), _mm_mul_ps(rdy, qy)), _mm_mul_ps(rdz, qz)), invDet);
+        ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpnlt_ps(v, zero), _mm_cmpngt_ps(_mm_add_ps(u, v), one)));
+
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+        ok = _mm_and_ps(ok, _mm_cmpnle_ps(t, zero));
+
+        unsigned mask = (unsigned)_mm_movemask_ps(ok) & ((1u << std::min(4, count - base)) - 1u);
+        if (!mask) continue;
+        _mm_store_ps(tl, t);
+        for (int lane = 0; lane < 4; ++lane)
+            if (mask & (1u << lane)) AcceptTriHit(best, tl[lane], p.id[base + lane]);
+    }
+}
+
+TARGET_AVX2 static void TriRangeAVX2(const TriPacket& p, int count,
+                                     const glm::vec3& ro, const glm::vec3& rd, RayHit& best)
+{
+    const __m256 rdx = _mm256_set1_ps(rd.x), rdy = _mm256_set1_ps(rd.y), rdz = _mm256_set1_ps(rd.z);
+    const __m256 rox = _mm256_set1_ps(ro.x), roy = _mm256_set1_ps(ro.y), roz = _mm256_set1_ps(ro.z);
+    const __m256 eps = _mm256_set1_ps(1e-6f), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    alignas(32) float tl[8];
+
+    for (int base = 0; base < count; base += 8) {
+        __m256 e1x = _mm256_load_ps(p.e1x + base), e1y = _mm256_load_ps(p.e1y + base), e1z = _mm256_load_ps(p.e1z + base);
+        __m256 e2x = _mm256_load_ps(p.e2x + base), e2y = _mm256_load_ps(p.e2y + base), e2z = _mm256_load_ps(p.e2z + base);
+
+        __m256 px = _mm256_sub_ps(_mm256_mul_ps(rdy, e2z), _mm256_mul_ps(rdz, e2y));
+        __m256 py = _mm256_sub_ps(_mm256_mul_ps(rdz, e2x), _mm256_mul_ps(rdx, e2z));
+        __m256 pz = _mm256_sub_ps(_mm256_mul_ps(rdx, e2y), _mm256_mul_ps(rdy, e2x));
+        __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+        __m256 ok = _mm256_cmp_ps(_mm256_and_ps(det, absMask), eps, _CMP_NLT_UQ);
+        __m256 invDet = _mm256_div_ps(one, det);
+
+        __m256 tx = _mm256_sub_ps(rox, _mm256_load_ps(p.v0x + base));
+        __m256 ty = _mm256_sub_ps(roy, _mm256_load_ps(p.v0y + base));
+        __m256 tz = _mm256_sub_ps(roz, _mm256_load_ps(p.v0z + base));
+        __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), invDet);
+        ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_NLT_UQ), _mm256_cmp_ps(u, one, _CMP_NGT_UQ)));
+
+        __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+        __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+        __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+        __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rdx, qx), _mm256_mul_ps(rdy, qy)), _mm256_mul_ps(rdz, qz)), invDet);
+        ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_NLT_UQ),
+                                             _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_NGT_UQ)));
+
+        __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(t, zero, _CMP_NLE_UQ));
+
+        unsigned mask = (unsigned)_mm256_movemask_ps(ok) & ((1u << std::min(8, count - base)) - 1u);
+        if (!mask) continue;
+        _mm256_store_ps(tl, t);
+        for (int lane = 0; lane < 8; ++lane)
+            if (mask & (1u << lane)) AcceptTriHit(best, tl[lane], p.id[base + lane]);
+    }
+}
+
+static bool CpuHasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7) return false;
+    __cpuid(r, 1);
+    bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;  // OS must save YMM state
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+#endif
+}
+#endif
+
+// ---------- Compact floor triangles ----------
+// Floor triangles as the queries read them. Every vertex is snapped to one power-of-two
+// lattice over the whole map and stored as 16-bit offsets from the origin of its chunk, a run
+// of up to TRI_PACKET triangles of one BVH leaf. A chunk keeps each of its vertices once and
+// its triangles index them with a byte per corner. A vertex shared by two chunks lands on the
+// same lattice point in both, so neighbouring triangles still meet exactly. Positions decode
+// as lattice * step + base; only in-place height shifts move base.
+const float TRI_LATTICE_STEP = 1.0f / 1024.0f;  // finest step; coarser only if a chunk spans more than 64 m
+const int   TRI_CHUNK_VERTS = 3 * TRI_PACKET;
+
+struct TriChunk {
+    int32_t  origin[3];  // lattice point the offsets count from
+    uint32_t firstVert;  // the chunk's vertices end where the next chunk's begin
+    uint32_t firstTri;   // triangle ids are firstTri + lane
+};
+
+// Per chunk, 'coords' holds the n vertices as x[n] y[n] z[n] from 3 * firstVert and 'corners'
+// the m triangles as first[m] second[m] third[m] from 3 * firstTri, so a packet decodes with
+// whole-register loads. Both arrays end in TRI_PACKET padding entries for those loads.
+struct CompactTris {
+    float     step = TRI_LATTICE_STEP;
+    glm::vec3 base{ 0.0f };
+    std::vector<TriChunk> chunks;   // plus a sentinel after the last one
+    std::vector<uint16_t> coords;
+    std::vector<uint8_t>  corners;
+
+    size_t Size() const { return chunks.empty() ? 0 : chunks.back().firstTri; }
+    size_t MemoryBytes() const {
+        return chunks.size() * sizeof(TriChunk) + coords.size() * sizeof(uint16_t) + corners.size();
+    }
+
+    // 'tris' in storage order; a new chunk starts at every index in 'chunkStarts'
+    void Build(const std::vector<Tri>& tris, const std::vector<uint32_t>& chunkStarts);
+    void ShiftY(float dy) { base.y += dy; }
+
+    // Expands one chunk into the packet lanes and returns its triangle count.
+    int  Decode(int chunk, TriPacket& p) const;
+    Tri  GetTri(int tri) const;
+    std::vector<Tri> Decode() const;  // every triangle, for the builds that walk all of them
+    void GrowBounds(int chunk, glm::vec3& lo, glm::vec3& hi) const;
+
+private:
+    // the chunk's vertices in world space, x[n] y[n] z[n]; returns n
+    int DecodeVerts(int chunk, float* xyz) const;
+    int ChunkOf(int tri) const {
+        auto it = std::upper_bound(chunks.begin(), chunks.end() - 1, (uint32_t)tri,
+                                   [](uint32_t t, const TriChunk& c) { return t < c.firstTri; });
+        return (int)(it - chunks.begin()) - 1;
+    }
+};
+
+void CompactTris::Build(const std::vector<Tri>& tris, const std::vector<uint32_t>& chunkStarts) {
+    *this = CompactTris();
+    if (tris.empty()) return;
+    auto chunkEnd = [&](size_t k) { return k + 1 < chunkStarts.size() ? chunkStarts[k + 1] : (uint32_t)tris.size(); };
+
+    // the lattice has to fit every chunk's extent into 16 bits and keep every coordinate an exact float
+    float need = 0.0f;
+    for (size_t k = 0; k < chunkStarts.size(); ++k) {
+        glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+        for (uint32_t i = chunkStarts[k]; i < chunkEnd(k); ++i) {
+            const Tri& t = tris[i];
+            lo = glm::min(lo, glm::min(t.a, glm::min(t.b, t.c)));
+            hi = glm::max(hi, glm::max(t.a, glm::max(t.b, t.c)));
+        }
+        for (int a = 0; a < 3; ++a)
+            need = std::max({ need, (hi[a] - lo[a]) / 65534.0f, std::max(-lo[a], hi[a]) / 8388608.0f });
+    }
+    while (step < need) step *= 2.0f;
+    float inv = 1.0f / step;
+
+    chunks.reserve(chunkStarts.size() + 1);
+    coords.reserve(tris.size() * 3 + TRI_PACKET);
+    corners.resize(tris.size() * 3 + TRI_PACKET, 0);
+    std::vector<int32_t> lx, ly, lz;  // lattice coordinates of the chunk's distinct vertices
+    for (size_t k = 0; k < chunkStarts.size(); ++k) {
+        uint32_t first = chunkStarts[k], m = chunkEnd(k) - first;
+        lx.clear(); ly.clear(); lz.clear();
+        for (uint32_t i = 0; i < m; ++i) {
+            const Tri& t = tris[first + i];
+            const glm::vec3* corner[3] = { &t.a, &t.b, &t.c };
+            for (int j = 0; j < 3; ++j) {
+                int32_t qx = (int32_t)std::lround(corner[j]->x * inv);
+                int32_t qy = (int32_t)std::lround(corner[j]->y * inv);
+                int32_t qz = (int32_t)std::lround(corner[j]->z * inv);
+                size_t v = 0;
+                while (v < lx.size() && (lx[v] != qx || ly[v] != qy || lz[v] != qz)) ++v;
+                if (v == lx.size()) { lx.push_back(qx); ly.push_back(qy); lz.push_back(qz); }
+                corners[3 * first + j * m + i] = (uint8_t)v;
+            }
+        }
+        TriChunk c{ { *std::min_element(lx.begin(), lx.end()), *std::min_element(ly.begin(), ly.end()),
+                      *std::min_element(lz.begin(), lz.end()) }, (uint32_t)(coords.size() / 3), first };
+        for (int32_t v : lx) coords.push_back((uint16_t)(v - c.origin[0]));
+        for (int32_t v : ly) coords.push_back((uint16_t)(v - c.origin[1]));
+        for (int32_t v : lz) coords.push_back((uint16_t)(v - c.origin[2]));
+        chunks.push_back(c);
+    }
+    chunks.push_back({ { 0, 0, 0 }, (uint32_t)(coords.size() / 3), (uint32_t)tris.size() });
+    coords.resize(coords.size() + TRI_PACKET, 0);
+    coords.shrink_to_fit();
+}
+
+int CompactTris::DecodeVerts(int chunk, float* xyz) const {
+    const TriChunk& c = chunks[chunk];
+    int n = (int)(chunks[chunk + 1].firstVert - c.firstVert);
+    const uint16_t* q = &coords[3 * c.firstVert];
+    for (int a = 0; a < 3; ++a, q += n, xyz += n)
+        for (int i = 0; i < n; ++i) xyz[i] = (float)(c.origin[a] + q[i]) * step + base[a];
+    return n;
+}
+
+int CompactTris::Decode(int chunk, TriPacket& p) const {
+    float xyz[3 * TRI_CHUNK_VERTS];
+    int n = DecodeVerts(chunk, xyz);
+    const float *x = xyz, *y = xyz + n, *z = xyz + 2 * n;
+
+    const TriChunk& c = chunks[chunk];
+    int m = (int)(chunks[chunk + 1].firstTri - c.firstTri);
+    const uint8_t* k = &corners[3 * c.firstTri];
+    for (int i = 0; i < m; ++i) {
+        int a = k[i], b = k[m + i], d = k[2 * m + i];
+        p.v0x[i] = x[a];        p.v0y[i] = y[a];        p.v0z[i] = z[a];
+        p.e1x[i] = x[b] - x[a]; p.e1y[i] = y[b] - y[a]; p.e1z[i] = z[b] - z[a];
+        p.e2x[i] = x[d] - x[a]; p.e2y[i] = y[d] - y[a]; p.e2z[i] = z[d] - z[a];
+        p.id[i] = (int)c.firstTri + i;
+    }
+    return m;
+}
+
+Tri CompactTris::GetTri(int tri) const {
+    int chunk = ChunkOf(tri);
+    float xyz[3 * TRI_CHUNK_VERTS];
+    int n = DecodeVerts(chunk, xyz);
+    const TriChunk& c = chunks[chunk];
+    int m = (int)(chunks[chunk + 1].firstTri - c.firstTri), lane = tri - (int)c.firstTri;
+    const uint8_t* k = &corners[3 * c.firstTri + lane];
+    auto at = [&](int v) { return glm::vec3(xyz[v], xyz[n + v], xyz[2 * n + v]); };
+    glm::vec3 a = at(k[0]), b = at(k[m]), d = at(k[2 * m]);
+    return { a, b, d, glm::normalize(glm::cross(b - a, d - a)) };
+}
+
+std::vector<Tri> CompactTris::Decode() const {
+    std::vector<Tri> out;
+    out.reserve(Size());
+    for (size_t c = 0; c + 1 < chunks.size(); ++c)
+        for (uint32_t t = chunks[c].firstTri; t < chunks[c + 1].firstTri; ++t) out.push_back(GetTri((int)t));
+    return out;
+}
+
+void CompactTris::GrowBounds(int chunk, glm::vec3& lo, glm::vec3& hi) const {
+    float xyz[3 * TRI_CHUNK_VERTS];
+    int n = DecodeVerts(chunk, xyz);
+    for (int i = 0; i < n; ++i) {
+        glm::vec3 p(xyz[i], xyz[n + i], xyz[2 * n + i]);
+        lo = glm::min(lo, p); hi = glm::max(hi, p);
+    }
+}
+
+#ifdef TRI_SIMD_X86
+// Decode with the chunk's vertices held in registers, eight per group, and every corner
+// fetched with an in-register permute. Same operations as DecodeVerts, so the same floats.
+TARGET_AVX2 static int DecodeChunkAVX2(const CompactTris& mesh, int chunk, TriPacket& p) {
+    const TriChunk& c = mesh.chunks[chunk];
+    int n = (int)(mesh.chunks[chunk + 1].firstVert - c.firstVert);
+    int m = (int)(mesh.chunks[chunk + 1].firstTri - c.firstTri);
+    const uint16_t* q = &mesh.coords[3 * c.firstVert];
+    const uint8_t*  k = &mesh.corners[3 * c.firstTri];
+    const __m256i ia = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)k));
+    const __m256i ib = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(k + m)));
+    const __m256i ic = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(k + 2 * m)));
+    const __m256 step = _mm256_set1_ps(mesh.step);
+
+    __m256 out[9];  // corner a, b, c times x, y, z
+    for (int g = 0; g < n; g += 8) {
+        __m256 v[3];
+        for (int a = 0; a < 3; ++a) {
+            __m256i lat = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(q + a * n + g))),
+                                           _mm256_set1_epi32(c.origin[a]));
+            v[a] = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lat), step), _mm256_set1_ps(mesh.base[a]));
+        }
+        const __m256i gv = _mm256_set1_epi32(g);
+        const __m256i idx[3] = { _mm256_sub_epi32(ia, gv), _mm256_sub_epi32(ib, gv), _mm256_sub_epi32(ic, gv) };
+        for (int j = 0; j < 3; ++j) {
+            // lanes whose corner is in this group of eight take it from here
+            __m256 in = _mm256_castsi256_ps(_mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), idx[j]),
+                                                                _mm256_cmpgt_epi32(_mm256_set1_epi32(8), idx[j])));
+            for (int a = 0; a < 3; ++a) {
+                __m256 got = _mm256_permutevar8x32_ps(v[a], idx[j]);
+                out[j * 3 + a] = g == 0 ? got : _mm256_blendv_ps(out[j * 3 + a], got, in);
+            }
+        }
+    }
+    _mm256_store_ps(p.v0x, out[0]); _mm256_store_ps(p.v0y, out[1]); _mm256_store_ps(p.v0z, out[2]);
+    _mm256_store_ps(p.e1x, _mm256_sub_ps(out[3], out[0]));
+    _mm256_store_ps(p.e1y, _mm256_sub_ps(out[4], out[1]));
+    _mm256_store_ps(p.e1z, _mm256_sub_ps(out[5], out[2]));
+    _mm256_store_ps(p.e2x, _mm256_sub_ps(out[6], out[0]));
+    _mm256_store_ps(p.e2y, _mm256_sub_ps(out[7], out[1]));
+    _mm256_store_ps(p.e2z, _mm256_sub_ps(out[8], out[2]));
+    _mm256_storeu_si256((__m256i*)p.id, _mm256_add_epi32(_mm256_set1_epi32((int)c.firstTri), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    return m;
+}
+#endif
+
+static int DecodeChunkScalar(const CompactTris& mesh, int chunk, TriPacket& p) { return mesh.Decode(chunk, p); }
+
+using TriDecodeFn = int(*)(const CompactTris&, int chunk, TriPacket&);
+
+struct TriKernelInfo { const char* name; TriRangeKernel fn; TriDecodeFn decode; int width; };
+
+// Every kernel this CPU can run, scalar first; the last one is the fastest.
+std::vector<TriKernelInfo> AvailableTriKernels() {
+    std::vector<TriKernelInfo> k{ { "scalar", TriRangeScalar, DecodeChunkScalar, 1 } };
+#ifdef TRI_SIMD_X86
+    k.push_back({ "sse", TriRangeSSE, DecodeChunkScalar, 4 });
+    if (CpuHasAVX2()) k.push_back({ "avx2", TriRangeAVX2, DecodeChunkAVX2, 8 });
+#endif
+    return k;
+}
+
+TriKernelInfo gTriKernel = AvailableTriKernels().back();
+
+// ---------- Triangle BVH (binned SAH, flattened) ----------
+// Children of an inner node are stored next to each other: left = leftFirst, right = leftFirst + 1.
+// For a leaf, count > 0 and leftFirst is its first chunk in 'mesh'; it has one chunk per
+// TRI_PACKET triangles.
+struct BVHNode {
+    glm::vec3 bmin; int leftFirst;
+    glm::vec3 bmax; int count;
+};
+
+const int   BVH_BINS = 12;
+const int   BVH_MAX_LEAF = TRI_PACKET;  // one AVX2 packet per leaf
+const float BVH_PAD = 1e-4f;  // keeps slab tests conservative against Möller–Trumbore rounding
+
+struct TriBVH {
+    std::vector<BVHNode> nodes;
+    CompactTris          mesh;  // the triangles in leaf order; their ids are positions in it
+
+    // 'stored', when given, receives the input triangles in storage order, so stored[i] is
+    // what mesh triangle i was quantized from.
+    void Build(const std::vector<Tri>& tris, std::vector<Tri>* stored = nullptr);
+    void ShiftY(float dy) { mesh.ShiftY(dy); Refit(); }
+    bool Raycast(const glm::vec3& ro, const glm::vec3& rd, float tMax, RayHit& hit) const;
+    bool AnyHit(const glm::vec3& ro, const glm::vec3& rd, float tMax) const;
+    size_t MemoryBytes() const { return nodes.size() * sizeof(BVHNode) + mesh.MemoryBytes(); }
+
+private:
+    std::vector<int>       triIdx;     // build only
+    std::vector<glm::vec3> centroids;  // build only
+    void UpdateBounds(const std::vector<Tri>& tris, BVHNode& node) const;
+    void Subdivide(const std::vector<Tri>& tris, int nodeIdx);
+    void Refit();
+    static int LeafChunks(const BVHNode& n) { return (n.count + TRI_PACKET - 1) / TRI_PACKET; }
+};
+
+static inline float HalfArea(const glm::vec3& e) { return e.x * e.y + e.y * e.z + e.z * e.x; }
+
+void TriBVH::UpdateBounds(const std::vector<Tri>& tris, BVHNode& node) const {
+    node.bmin = glm::vec3(std::numeric_limits<float>::max());
+    node.bmax = glm::vec3(-std::numeric_limits<float>::max());
+    for (int i = 0; i < node.count; ++i) {
+        const Tri& t = tris[triIdx[node.leftFirst + i]];
+        node.bmin = glm::min(node.bmin, glm::min(t.a, glm::min(t.b, t.c)));
+        node.bmax = glm::max(node.bmax, glm::max(t.a, glm::max(t.b, t.c)));
+    }
+    node.bmin -= glm::vec3(BVH_PAD);
+    node.bmax += glm::vec3(BVH_PAD);
+}
+
+void TriBVH::Subdivide(const std::vector<Tri>& tris, int nodeIdx) {
+    BVHNode& node = nodes[nodeIdx];
+    if (node.count <= BVH_MAX_LEAF) return;
+
+    // centroid bounds drive the bin placement
+    glm::vec3 cmin(std::numeric_limits<float>::max()), cmax(-std::numeric_limits<float>::max());
+    for (int i = 0; i < node.count; ++i) {
+        const glm::vec3& c = centroids[triIdx[node.leftFirst + i]];
+        cmin = glm::min(cmin, c); cmax = glm::max(cmax, c);
+    }
+
+    struct Bin { glm::vec3 bmin, bmax; int count; };
+    float bestCost = std::numeric_limits<float>::max();
+    int   bestAxis = -1;
+    float bestSplit = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        float lo = cmin[axis], hi = cmax[axis];
+        if (hi - lo < 1e-6f) continue;
+        Bin bins[BVH_BINS];
+        for (auto& b : bins) {
+            b.bmin = glm::vec3(std::numeric_limits<float>::max());
+            b.bmax = glm::vec3(-std::numeric_limits<float>::max());
+            b.count = 0;
+        }
+        float scale = BVH_BINS / (hi - lo);
+        for (int i = 0; i < node.count; ++i) {
+            int ti = triIdx[node.leftFirst + i];
+            const Tri& t = tris[ti];
+            int b = std::min(BVH_BINS - 1, (int)((centroids[ti][axis] - lo) * scale));
+            bins[b].count++;
+            bins[b].bmin = glm::min(bins[b].bmin, glm::min(t.a, glm::min(t.b, t.c)));
+            bins[b].bmax = glm::max(bins[b].bmax, glm::max(t.a, glm::max(t.b, t.c)));
+        }
+        // sweep from both sides to get the cost of each of the BVH_BINS-1 planes
+        float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+        int   leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+        glm::vec3 lmin(std::numeric_limits<float>::max()), lmax(-std::numeric_limits<float>::max());
+        glm::vec3 rmin = lmin, rmax = lmax;
+        int lsum = 0, rsum = 0;
+        for (int i = 0; i < BVH_BINS - 1; ++i) {
+            lsum += bins[i].count; leftCount[i] = lsum;
+            lmin = glm::min(lmin, bins[i].bmin); lmax = glm::max(lmax, bins[i].bmax);
+            leftArea[i] = lsum ? HalfArea(lmax - lmin) : 0.0f;
+            int j = BVH_BINS - 1 - i;
+            rsum += bins[j].count; rightCount[j - 1] = rsum;
+            rmin = glm::min(rmin, bins[j].bmin); rmax = glm::max(rmax, bins[j].bmax);
+            rightArea[j - 1] = rsum ? HalfArea(rmax - rmin) : 0.0f;
+        }
+        for (int i = 0; i < BVH_BINS - 1; ++i) {
+            if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+            float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if (cost < bestCost) { bestCost = cost; bestAxis = axis; bestSplit = lo + (i + 1) / scale; }
+        }
+    }
+
+    float leafCost = node.count * HalfArea(node.bmax - node.bmin);
+    if (bestAxis < 0 || bestCost >= leafCost) return;
+
+    // partition in place
+    int i = node.leftFirst, j = i + node.count - 1;
+    while (i <= j) {
+        if (centroids[triIdx[i]][bestAxis] < bestSplit) ++i;
+        else std::swap(triIdx[i], triIdx[j--]);
+    }
+    int leftCount = i - node.leftFirst;
+    if (leftCount == 0 || leftCount == node.count) return;
+
+    int left = (int)nodes.size();
+    BVHNode l{}, r{};
+    l.leftFirst = node.leftFirst; l.count = leftCount;
+    r.leftFirst = i;              r.count = node.count - leftCount;
+    node.leftFirst = left; node.count = 0;   // 'node' is invalid after the push_back below
+    UpdateBounds(tris, l); UpdateBounds(tris, r);
+    nodes.push_back(l); nodes.push_back(r);
+    Subdivide(tris, left);
+    Subdivide(tris, left + 1);
+}
+
+void TriBVH::Build(const std::vector<Tri>& tris, std::vector<Tri>* stored) {
+    nodes.clear(); triIdx.clear();
+    if (tris.empty()) return;
+
+    triIdx.resize(tris.size());
+    centroids.resize(tris.size());
+    for (size_t i = 0; i < tris.size(); ++i) {
+        triIdx[i] = (int)i;
+        centroids[i] = (tris[i].a + tris[i].b + tris[i].c) / 3.0f;
+    }
+    nodes.reserve(tris.size() * 2);
+    BVHNode root{};
+    root.leftFirst = 0; root.count = (int)tris.size();
+    UpdateBounds(tris, root);
+    nodes.push_back(root);
+    Subdivide(tris, 0);
+    centroids.clear(); centroids.shrink_to_fit();
+
+    // store the triangles leaf by leaf, one chunk per TRI_PACKET of them
+    std::vector<Tri> ordered;
+    std::vector<uint32_t> chunkStarts;
+    ordered.reserve(tris.size());
+    for (BVHNode& n : nodes) {
+        if (n.count == 0) continue;
+        int first = n.leftFirst;
+        n.leftFirst = (int)chunkStarts.size();
+        for (int i = 0; i < n.count; ++i) {
+            if (i % TRI_PACKET == 0) chunkStarts.push_back((uint32_t)ordered.size());
+            ordered.push_back(tris[triIdx[first + i]]);
+        }
+    }
+    triIdx.clear(); triIdx.shrink_to_fit();
+    mesh.Build(ordered, chunkStarts);
+    Refit();  // around the snapped vertices
+    if (stored) *stored = std::move(ordered);
+}
+
+// Recompute bounds bottom-up from the stored vertices (children always follow their parent).
+void TriBVH::Refit() {
+    for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+        BVHNode& n = nodes[i];
+        if (n.count > 0) {
+            n.bmin = glm::vec3(std::numeric_limits<float>::max());
+            n.bmax = glm::vec3(-std::numeric_limits<float>::max());
+            for (int c = n.leftFirst; c < n.leftFirst + LeafChunks(n); ++c) mesh.GrowBounds(c, n.bmin, n.bmax);
+            n.bmin -= glm::vec3(BVH_PAD);
+            n.bmax += glm::vec3(BVH_PAD);
+            continue;
+        }
+        const BVHNode& l = nodes[n.leftFirst];
+        const BVHNode& r = nodes[n.leftFirst + 1];
+        n.bmin = glm::min(l.bmin, r.bmin);
+        n.bmax = glm::max(l.bmax, r.bmax);
+    }
+}
+
+static inline glm::vec3 SafeInvDir(const glm::vec3& rd) {
+    auto inv = [](float d) { return 1.0f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d)); };
+    return { inv(rd.x), inv(rd.y), inv(rd.z) };
+}
+
+// Slab test; returns entry distance or +inf on miss
+static inline float RayNodeEntry(const BVHNode& n, const glm::vec3& ro, const glm::vec3& invD, float tMax) {
+    glm::vec3 t0 = (n.bmin - ro) * invD;
+    glm::vec3 t1 = (n.bmax - ro) * invD;
+    glm::vec3 tn = glm::min(t0, t1), tf = glm::max(t0, t1);
+    float tNear = std::max(std::max(tn.x, tn.y), std::max(tn.z, 0.0f));
+    float tFar = std::min(std::min(tf.x, tf.y), std::min(tf.z, tMax));
+    return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+}
+
+bool TriBVH::Raycast(const glm::vec3& ro, const glm::vec3& rd, float tMax, RayHit& hit) const {
+    hit.t = tMax; hit.tri = -1;
+    if (nodes.empty()) return false;
+    const float INF = std::numeric_limits<float>::infinity();
+    glm::vec3 invD = SafeInvDir(rd);
+    TriPacket packet;
+
+    int stack[64]; int sp = 0;
+    if (RayNodeEntry(nodes[0], ro, invD, hit.t) == INF) return false;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const BVHNode& n = nodes[stack[--sp]];
+        if (n.count > 0) {
+            // equal t keeps the lowest index so results match a linear scan
+            for (int c = n.leftFirst; c < n.leftFirst + LeafChunks(n); ++c)
+                gTriKernel.fn(packet, gTriKernel.decode(mesh, c, packet), ro, rd, hit);
+            continue;
+        }
+        int a = n.leftFirst, b = n.leftFirst + 1;
+        float da = RayNodeEntry(nodes[a], ro, invD, hit.t);
+        float db = RayNodeEntry(nodes[b], ro, invD, hit.t);
+        if (da > db) { std::swap(a, b); std::swap(da, db); }
+        // push the far child first so the near one is popped next
+        if (db != INF) stack[sp++] = b;
+        if (da != INF) stack[sp++] = a;
+    }
+    return hit.tri >= 0;
+}
+
+bool TriBVH::AnyHit(const glm::vec3& ro, const glm::vec3& rd, float tMax) const {
+    if (nodes.empty()) return false;
+    const float INF = std::numeric_limits<float>::infinity();
+    glm::vec3 invD = SafeInvDir(rd);
+    TriPacket packet;
+
+    int stack[64]; int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const BVHNode& n = nodes[stack[--sp]];
+        if (RayNodeEntry(n, ro, invD, tMax) == INF) continue;
+        if (n.count > 0) {
+            RayHit h{ tMax, -1 };
+            for (int c = n.leftFirst; c < n.leftFirst + LeafChunks(n); ++c)
+                gTriKernel.fn(packet, gTriKernel.decode(mesh, c, packet), ro, rd, h);
+            if (h.tri >= 0) return true;
+            continue;
+        }
+        stack[sp++] = n.leftFirst + 1;
+        stack[sp++] = n.leftFirst;
+    }
+    return false;
+}
+
+TriBVH gFloorBVH;
+
+// ---------- Floor queries ----------
+// Closest floor hit along ro + t*rd for t in (0, tMax].
+bool RaycastFloor(const glm::vec3& ro, const glm::vec3& rd, float tMax, RayHit& hit) {
+    return gFloorBVH.Raycast(ro, rd, tMax, hit);
+}
+
+// True if the segment a->b touches any floor triangle (line-of-sight blocker test).
+bool SegmentHitsFloor(const glm::vec3& a, const glm::vec3& b) {
+    glm::vec3 d = b - a;
+    float len = glm::length(d);
+    if (len < 1e-6f) return false;
+    return gFloorBVH.AnyHit(a, d / len, len);
+}
+
+// Topmost floor under worldPosXZ, always through the triangle BVH.
+float SampleFloorYExact(const glm::vec3& worldPosXZ) {
+    glm::vec3 ro(worldPosXZ.x, 1000.0f, worldPosXZ.z);
+    glm::vec3 rd(0, -1, 0);
+
+    RayHit hit;
+    if (RaycastFloor(ro, rd, std::numeric_limits<float>::infinity(), hit)) return ro.y + hit.t * rd.y;
+    return MAP_Y_OFFSET;
+}
+
+// ---------- Floor heightfield (optional, F2) ----------
+// Floor triangles rasterized once onto a grid of sample nodes. Every node keeps all floor layers
+// (bridges, rooftops, ground below) sorted from the top, tagged with the triangle that produced
+// them. Lookups interpolate the four corners of the cell and fall back to the exact raycast
+// wherever the corners do not describe a single continuous surface.
+bool  gUseHeightfield = false;
+float HF_CELL = 0.25f;               // node spacing in world units
+const int   HF_MAX_LAYERS = 8;
+const float HF_LAYER_MERGE = 0.02f;  // hits closer than this on one node collapse into one layer
+const float HF_PLANE_TOL = 0.01f;    // corners on different planes must agree this well at the query point
+const float HF_TOP_TOL = 0.05f;      // geometry poking above the corners by more than this forces the exact path
+
+struct HFLayer { float h; int tri; };
+
+struct FloorHeightfield {
+    glm::vec2 origin{ 0.0f };
+    float cell = 0.0f, invCell = 0.0f;
+    int   nx = 0, nz = 0;                  // node counts; cells are (nx-1) x (nz-1)
+    std::vector<uint32_t>  nodeStart;      // CSR offsets into layers, nx*nz+1
+    std::vector<HFLayer>   layers;         // per node, highest first
+    std::vector<float>     cellTop;        // highest floor point anywhere inside each cell
+    std::vector<glm::vec3> planes;         // per floor tri: y = p.x*x + p.y*z + p.z
+
+    bool   Empty() const { return nx == 0; }
+    void   Clear() { *this = FloorHeightfield(); }
+    void   Build(const std::vector<Tri>& tris, float cellSize);
+    void   ShiftY(float dy);
+    bool   Sample(float x, float z, float& outY, int* outTri = nullptr) const;
+    size_t MemoryBytes() const {
+        return nodeStart.size() * sizeof(uint32_t) + layers.size() * sizeof(HFLayer)
+            + cellTop.size() * sizeof(float) + planes.size() * sizeof(glm::vec3);
+    }
+};
+
+// Highest point of a triangle inside an axis-aligned XZ rectangle (clip, then take max Y).
+static bool TriMaxYInRect(const Tri& t, float x0, float z0, float x1, float z1, float& outY) {
+    glm::vec3 a[9], b[9];
+    int n = 3; a[0] = t.a; a[1] = t.b; a[2] = t.c;
+    auto clip = [&](int axis, float bound, bool keepGreater) {
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            const glm::vec3& p = a[i];
+            const glm::vec3& q = a[(i + 1) % n];
+            float dp = keepGreater ? p[axis] - bound : bound - p[axis];
+            float dq = keepGreater ? q[axis] - bound : bound - q[axis];
+            if (dp >= 0.0f) b[m++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f)) b[m++] = p + (q - p) * (dp / (dp - dq));
+        }
+        n = m;
+        for (int i = 0; i < n; ++i) a[i] = b[i];
+    };
+    clip(0, x0, true);
+    if (n) clip(0, x1, false);
+    if (n) clip(2, z0, true);
+    if (n) clip(2, z1, false);
+    if (n == 0) return false;
+    outY = a[0].y;
+    for (int i = 1; i < n; ++i) outY = std::max(outY, a[i].y);
+    return true;
+}
+
+void FloorHeightfield::Build(const std::vector<Tri>& tris, float cellSize) {
+    Clear();
+    if (tris.empty()) return;
+
+    glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+    for (const Tri& t : tris) {
+        lo = glm::min(lo, glm::vec2(std::min({ t.a.x, t.b.x, t.c.x }), std::min({ t.a.z, t.b.z, t.c.z })));
+        hi = glm::max(hi, glm::vec2(std::max({ t.a.x, t.b.x, t.c.x }), std::max({ t.a.z, t.b.z, t.c.z })));
+    }
+    cell = cellSize; invCell = 1.0f / cell;
+    origin = lo;
+    nx = (int)std::ceil((hi.x - lo.x) * invCell) + 1;
+    nz = (int)std::ceil((hi.y - lo.y) * invCell) + 1;
+    nx = std::max(nx, 2); nz = std::max(nz, 2);
+
+    // gather node hits per node first, then compact to CSR
+    std::vector<std::vector<HFLayer>> hits(nx * nz);
+    cellTop.assign((nx - 1) * (nz - 1), -std::numeric_limits<float>::infinity());
+    planes.resize(tris.size());
+
+    for (int ti = 0; ti < (int)tris.size(); ++ti) {
+        const Tri& t = tris[ti];
+        glm::vec3 n = glm::cross(t.b - t.a, t.c - t.a);
+        if (n.y <= 0.0f) { planes[ti] = glm::vec3(0.0f); continue; }
+        planes[ti] = { -n.x / n.y, -n.z / n.y, glm::dot(n, t.a) / n.y };
+        const glm::vec3& P = planes[ti];
+
+        float minx = std::min({ t.a.x, t.b.x, t.c.x }), maxx = std::max({ t.a.x, t.b.x, t.c.x });
+        float minz = std::min({ t.a.z, t.b.z, t.c.z }), maxz = std::max({ t.a.z, t.b.z, t.c.z });
+        int i0 = std::max(0, (int)std::ceil((minx - origin.x) * invCell));
+        int i1 = std::min(nx - 1, (int)std::floor((maxx - origin.x) * invCell));
+        int j0 = std::max(0, (int)std::ceil((minz - origin.y) * invCell));
+        int j1 = std::min(nz - 1, (int)std::floor((maxz - origin.y) * invCell));
+
+        // 2D edge functions in XZ; triangles are upward-facing so the winding is consistent
+        glm::vec2 A(t.a.x, t.a.z), B(t.b.x, t.b.z), C(t.c.x, t.c.z);
+        auto edge = [](const glm::vec2& p, const glm::vec2& q, const glm::vec2& r) {
+            return (q.x - p.x) * (r.y - p.y) - (q.y - p.y) * (r.x - p.x);
+        };
+        float area = edge(A, B, C);
+        float eps = -1e-6f * std::abs(area);
+        for (int j = j0; j <= j1; ++j) {
+            for (int i = i0; i <= i1; ++i) {
+                glm::vec2 p(origin.x + i * cell, origin.y + j * cell);
+                float w0 = edge(B, C, p), w1 = edge(C, A, p), w2 = edge(A, B, p);
+                if (area < 0.0f) { w0 = -w0; w1 = -w1; w2 = -w2; }
+                if (w0 < eps || w1 < eps || w2 < eps) continue;
+                float h = P.x * p.x + P.y * p.y + P.z;
+
+                auto& L = hits[j * nx + i];
+                auto same = std::find_if(L.begin(), L.end(), [&](const HFLayer& l) { return std::abs(l.h - h) < HF_LAYER_MERGE; });
+                if (same != L.end()) { if (h > same->h) *same = { h, ti }; continue; }
+                L.push_back({ h, ti });
+            }
+        }
+
+        int ci0 = std::max(0, (int)std::floor((minx - origin.x) * invCell));
+        int ci1 = std::min(nx - 2, (int)std::floor((maxx - origin.x) * invCell));
+        int cj0 = std::max(0, (int)std::floor((minz - origin.y) * invCell));
+        int cj1 = std::min(nz - 2, (int)std::floor((maxz - origin.y) * invCell));
+        for (int j = cj0; j <= cj1; ++j) {
+            for (int i = ci0; i <= ci1; ++i) {
+                float x0 = origin.x + i * cell, z0 = origin.y + j * cell, top;
+                if (TriMaxYInRect(t, x0, z0, x0 + cell, z0 + cell, top)) {
+                    float& ct = cellTop[j * (nx - 1) + i];
+                    ct = std::max(ct, top);
+                }
+            }
+        }
+    }
+
+    nodeStart.resize(nx * nz + 1);
+    nodeStart[0] = 0;
+    for (int k = 0; k < nx * nz; ++k) {
+        auto& L = hits[k];
+        std::sort(L.begin(), L.end(), [](const HFLayer& a, const HFLayer& b) { return a.h > b.h; });
+        if ((int)L.size() > HF_MAX_LAYERS) L.resize(HF_MAX_LAYERS);
+        nodeStart[k + 1] = nodeStart[k] + (uint32_t)L.size();
+    }
+    layers.reserve(nodeStart.back());
+    for (const auto& L : hits) layers.insert(layers.end(), L.begin(), L.end());
+}
+
+void FloorHeightfield::ShiftY(float dy) {
+    for (auto& l : layers) l.h += dy;
+    for (auto& t : cellTop) t += dy;
+    for (auto& p : planes) p.z += dy;
+}
+
+bool FloorHeightfield::Sample(float x, float z, float& outY, int* outTri) const {
+    if (nx == 0) return false;
+    float fx = (x - origin.x) * invCell, fz = (z - origin.y) * invCell;
+    int i = (int)std::floor(fx), j = (int)std::floor(fz);
+    if (i < 0 || j < 0 || i >= nx - 1 || j >= nz - 1) return false;
+    float tx = fx - i, tz = fz - j;
+
+    const int node[4] = { j * nx + i, j * nx + i + 1, (j + 1) * nx + i, (j + 1) * nx + i + 1 };
+    HFLayer c[4];
+    for (int k = 0; k < 4; ++k) {
+        if (nodeStart[node[k]] == nodeStart[node[k] + 1]) return false;   // no floor at this corner
+        c[k] = layers[nodeStart[node[k]]];
+    }
+    float hiCorner = std::max(std::max(c[0].h, c[1].h), std::max(c[2].h, c[3].h));
+    if (cellTop[j * (nx - 1) + i] > hiCorner + HF_TOP_TOL) return false;
+
+    if (c[0].tri == c[1].tri && c[0].tri == c[2].tri && c[0].tri == c[3].tri) {
+        float h0 = glm::mix(c[0].h, c[1].h, tx);
+        float h1 = glm::mix(c[2].h, c[3].h, tx);
+        outY = glm::mix(h0, h1, tz);
+        if (outTri) *outTri = c[0].tri;
+        return true;
+    }
+
+    // corners come from different triangles: accept only if their planes meet at the query point
+    float lo = std::numeric_limits<float>::max(), hi = -lo, sum = 0.0f;
+    for (int k = 0; k < 4; ++k) {
+        const glm::vec3& P = planes[c[k].tri];
+        float h = P.x * x + P.y * z + P.z;
+        lo = std::min(lo, h); hi = std::max(hi, h); sum += h;
+    }
+    if (hi - lo > HF_PLANE_TOL) return false;
+    outY = sum * 0.25f;
+    if (outTri) *outTri = c[0].tri;
+    return true;
+}
+
+FloorHeightfield gFloorHF;
+
+void ReportFloorHeightfield(double buildMs) {
+    // error and fallback rate against the exact path on a fixed pseudo-random sample set
+    const int N = 20000;
+    uint32_t seed = 12345u;
+    auto rnd = [&]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+    float span = gFloorHF.cell;
+    double sumErr = 0.0; float maxErr = 0.0f; int answered = 0;
+    for (int k = 0; k < N; ++k) {
+        float x = gFloorHF.origin.x + rnd() * (gFloorHF.nx - 1) * span;
+        float z = gFloorHF.origin.y + rnd() * (gFloorHF.nz - 1) * span;
+        float y;
+        if (!gFloorHF.Sample(x, z, y)) continue;
+        float e = std::abs(y - SampleFloorYExact({ x, 0.0f, z }));
+        sumErr += e; maxErr = std::max(maxErr, e); ++answered;
+    }
+    std::cout << "[Heightfield] " << gFloorHF.nx << "x" << gFloorHF.nz << " nodes @" << HF_CELL
+        << " layers=" << gFloorHF.layers.size()
+        << " mem=" << gFloorHF.MemoryBytes() / 1024 << "KB build=" << buildMs << "ms"
+        << " err(mean=" << (answered ? sumErr / answered : 0.0) << " max=" << maxErr << ")"
+        << " fallback=" << 100.0f * (N - answered) / N << "%\n";
+}
+
+void BuildFloorHeightfield() {
+    auto t0 = std::chrono::steady_clock::now();
+    gFloorHF.Build(gFloorBVH.mesh.Decode(), HF_CELL);
+    ReportFloorHeightfield(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+}
+
+float SampleFloorY(const glm::vec3& worldPosXZ) {
+    PROFILE_SCOPE(PROF_FLOOR);
+    float y;
+    if (gUseHeightfield && gFloorHF.Sample(worldPosXZ.x, worldPosXZ.z, y)) return y;
+    return SampleFloorYExact(worldPosXZ);
+}
+
+// ---------- Floor queries ----------
+// Height plus the normal of the floor triangle under a point; up with MAP_Y_OFFSET when
+// there is no floor below. The normal comes from the triangle's stored corners.
+struct FloorSample { float y; glm::vec3 normal; };
+
+// Bumped whenever floor answers can change: collider installs, in-place shifts and the
+// heightfield toggle. Cached samples from older generations are ignored.
+uint32_t gColliderGeneration = 1;
+
+void InvalidateFloorQueries() { ++gColliderGeneration; }
+
+FloorSample SampleFloor(float x, float z) {
+    float y;
+    int tri = -1;
+    if (gUseHeightfield && gFloorHF.Sample(x, z, y, &tri)) return { y, gFloorBVH.mesh.GetTri(tri).n };
+    RayHit hit;
+    if (RaycastFloor({ x, 1000.0f, z }, { 0.0f, -1.0f, 0.0f }, std::numeric_limits<float>::infinity(), hit))
+        return { 1000.0f - hit.t, gFloorBVH.mesh.GetTri(hit.tri).n };
+    return { MAP_Y_OFFSET, { 0.0f, 1.0f, 0.0f } };
+}
+
+// Memoized floor queries. Points are snapped to a FLOOR_QUERY_STEP lattice and the lattice
+// point is what gets sampled, so an answer depends only on its key and the collider generation,
+// never on which query filled the slot first. The table is direct-mapped and fixed-size;
+// collisions simply overwrite. One cache per thread of use (the player and the crowd each own one);
+// batches resolve their misses across the workers.
+const float  FLOOR_QUERY_STEP = 1.0f / 256.0f;   // lattice spacing in world units
+const int    FLOOR_CACHE_BITS = 12;
+const size_t FLOOR_BATCH_GRAIN = 512;
+
+class FloorQueryCache {
+public:
+    uint64_t hits = 0, misses = 0;
+
+    FloorSample Get(const glm::vec3& worldPosXZ) {
+        PROFILE_SCOPE(PROF_FLOOR);
+        int32_t qx = Quantize(worldPosXZ.x), qz = Quantize(worldPosXZ.z);
+        Entry& e = Slot(qx, qz);
+        if (e.gen == gColliderGeneration && e.qx == qx && e.qz == qz) { ++hits; return e.sample; }
+        ++misses;
+        e = { qx, qz, gColliderGeneration, SampleFloor(qx * FLOOR_QUERY_STEP, qz * FLOOR_QUERY_STEP) };
+        return e.sample;
+    }
+
+    float GetY(const glm::vec3& worldPosXZ) { return Get(worldPosXZ).y; }
+
+    // n points (structure-of-arrays in): hits are answered from the table, misses are sampled
+    // in one parallel pass and then stored.
+    void GetBatch(const float* x, const float* z, FloorSample* out, size_t n) {
+        PROFILE_SCOPE(PROF_FLOOR);
+        missIndex.clear();
+        for (size_t i = 0; i < n; ++i) {
+            int32_t qx = Quantize(x[i]), qz = Quantize(z[i]);
+            const Entry& e = Slot(qx, qz);
+            if (e.gen == gColliderGeneration && e.qx == qx && e.qz == qz) out[i] = e.sample;
+            else missIndex.push_back((uint32_t)i);
+        }
+        hits += n - missIndex.size();
+        misses += missIndex.size();
+        ParallelFor(missIndex.size(), FLOOR_BATCH_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t i = missIndex[k];
+                out[i] = SampleFloor(Quantize(x[i]) * FLOOR_QUERY_STEP, Quantize(z[i]) * FLOOR_QUERY_STEP);
+            }
+            });
+        for (uint32_t i : missIndex) {
+            int32_t qx = Quantize(x[i]), qz = Quantize(z[i]);
+            Slot(qx, qz) = { qx, qz, gColliderGeneration, out[i] };
+        }
+    }
+
+private:
+    struct Entry { int32_t qx = 0, qz = 0; uint32_t gen = 0; FloorSample sample{}; };
+
+    static int32_t Quantize(float v) { return (int32_t)std::lround(v * (1.0f / FLOOR_QUERY_STEP)); }
+    Entry& Slot(int32_t qx, int32_t qz) {
+        uint32_t h = ((uint32_t)qx * 73856093u) ^ ((uint32_t)qz * 19349663u);
+        return table[(h ^ (h >> 15)) & ((1u << FLOOR_CACHE_BITS) - 1)];
+    }
+
+    std::vector<Entry>    table = std::vector<Entry>(size_t(1) << FLOOR_CACHE_BITS);
+    std::vector<uint32_t> missIndex;
+};
+
+// ---------- Triangle kernel check / microbenchmark (F3, sim_benchmark --verify) ----------
+// Linear scan over every floor triangle for a fixed set of rays: the per-Tri
+// RaycastTri loop over the decoded triangles against each kernel decoding and
+// testing chunk by chunk. Returns how many (ray, kernel) pairs disagreed with
+// the RaycastTri loop; with 'timing' also prints ns/tri.
+size_t CompareTriKernels(int rays, bool timing) {
+    const CompactTris& mesh = gFloorBVH.mesh;
+    if (mesh.Size() == 0) return 0;
+    std::vector<Tri> tris = mesh.Decode();
+    int chunks = (int)mesh.chunks.size() - 1;
+    const float INF = std::numeric_limits<float>::infinity();
+    const BVHNode& root = gFloorBVH.nodes[0];
+
+    // deterministic rays: half straight down, half slanted across the map
+    std::vector<glm::vec3> ro(rays), rd(rays);
+    uint32_t seed = 12345u;
+    auto rnd = [&]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+    for (int i = 0; i < rays; ++i) {
+        glm::vec3 target(glm::mix(root.bmin.x, root.bmax.x, rnd()), root.bmin.y, glm::mix(root.bmin.z, root.bmax.z, rnd()));
+        ro[i] = target + glm::vec3(0, root.bmax.y - root.bmin.y + 10.0f, 0);
+        if (i & 1) ro[i] += glm::vec3(rnd() * 20.0f - 10.0f, 0, rnd() * 20.0f - 10.0f);
+        rd[i] = glm::normalize(target - ro[i]);
+    }
+
+    auto now = [] { return std::chrono::steady_clock::now(); };
+    auto nsPerTri = [&](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::nano>(now() - t0).count() / ((double)rays * tris.size());
+    };
+
+    std::vector<RayHit> ref(rays);
+    auto t0 = now();
+    for (int r = 0; r < rays; ++r) {
+        RayHit h{ INF, -1 };
+        for (size_t i = 0; i < tris.size(); ++i) {
+            float t;
+            if (RaycastTri(ro[r], rd[r], tris[i], t)) AcceptTriHit(h, t, (int)i);
+        }
+        ref[r] = h;
+    }
+    if (timing) std::cout << "[TriKernel] RaycastTri loop: " << nsPerTri(t0) << " ns/tri\n";
+
+    size_t mismatches = 0;
+    for (const TriKernelInfo& k : AvailableTriKernels()) {
+        size_t bad = 0;
+        TriPacket packet;
+        t0 = now();
+        for (int r = 0; r < rays; ++r) {
+            RayHit h{ INF, -1 };
+            for (int c = 0; c < chunks; ++c) k.fn(packet, k.decode(mesh, c, packet), ro[r], rd[r], h);
+            if (h.tri != ref[r].tri || (h.tri >= 0 && h.t != ref[r].t)) ++bad;
+        }
+        double ns = nsPerTri(t0);
+        if (timing || bad)
+            std::cout << "[TriKernel] " << k.name << (k.fn == gTriKernel.fn ? " (active)" : "")
+                      << ": " << ns << " ns/tri, mismatches=" << bad << "/" << rays << "\n";
+        mismatches += bad;
+    }
+    return mismatches;
+}
+
+// ---------- Floor BVH check (sim_benchmark --verify) ----------
+// Reference linear scan, kept to validate the BVH
+float SampleFloorYBrute(const std::vector<Tri>& tris, const glm::vec3& worldPosXZ) {
+    glm::vec3 ro(worldPosXZ.x, 1000.0f, worldPosXZ.z);
+    glm::vec3 rd(0, -1, 0);
+
+    float bestT = std::numeric_limits<float>::infinity();
+    bool  hit = false;
+
+    for (const Tri& tri : tris) {
+        float t;
+        if (RaycastTri(ro, rd, tri, t)) {
+            if (t > 0.0f && t < bestT) { bestT = t; hit = true; }
+        }
+    }
+    if (hit) return ro.y + bestT * rd.y;
+    return MAP_Y_OFFSET;
+}
+
+// A grid over the map plus a spread of triangle centroids.
+static std::vector<glm::vec3> FloorCheckSamples(const std::vector<Tri>& tris) {
+    const BVHNode& root = gFloorBVH.nodes[0];
+    std::vector<glm::vec3> samples;
+    const int N = 96;
+    for (int i = 0; i <= N; ++i)
+        for (int j = 0; j <= N; ++j)
+            samples.push_back({ glm::mix(root.bmin.x, root.bmax.x, i / (float)N), 0.0f,
+                                glm::mix(root.bmin.z, root.bmax.z, j / (float)N) });
+    for (size_t i = 0; i < tris.size(); i += std::max<size_t>(1, tris.size() / 4096)) {
+        const Tri& t = tris[i];
+        samples.push_back((t.a + t.b + t.c) / 3.0f);
+    }
+    return samples;
+}
+
+// Compare BVH and brute-force floor heights over FloorCheckSamples of the stored triangles.
+// Returns the number of samples where they differ.
+size_t VerifyFloorBVH() {
+    if (gFloorBVH.nodes.empty()) return 0;
+    std::vector<Tri> tris = gFloorBVH.mesh.Decode();
+    std::vector<glm::vec3> samples = FloorCheckSamples(tris);
+
+    size_t mismatches = 0;
+    for (const auto& p : samples) {
+        float fast = SampleFloorYExact(p), ref = SampleFloorYBrute(tris, p);
+        if (fast != ref) {
+            if (mismatches < 8) std::cout << "[FloorBVH] mismatch at (" << p.x << "," << p.z << "): "
+                << fast << " vs " << ref << "\n";
+            ++mismatches;
+        }
+    }
+    std::cout << "[FloorBVH] verify: " << samples.size() << " samples, " << mismatches << " mismatches\n";
+    return mismatches;
+}
+
+// The stored triangles against the float ones they were built from ('source', in storage
+// order from TriBVH::Build): every decoded vertex within half a lattice step of its source,
+// and SampleFloorYExact within FLOOR_LATTICE_MAX_ERROR of a brute-force scan of the source.
+// The lattice is one step for the whole map, so a single huge triangle coarsens every floor;
+// the height check is in meters so that shows up here. Returns the number of failures.
+const float FLOOR_LATTICE_MAX_ERROR = 0.01f;  // meters
+
+size_t VerifyFloorLattice(const std::vector<Tri>& source) {
+    const CompactTris& mesh = gFloorBVH.mesh;
+    if (gFloorBVH.nodes.empty()) return 0;
+    if (source.size() != mesh.Size()) {
+        std::cout << "[FloorLattice] verify: " << source.size() << " source triangles for " << mesh.Size() << " stored\n";
+        return 1;
+    }
+
+    size_t badVerts = 0;
+    float vertErr = 0.0f;
+    for (size_t i = 0; i < source.size(); ++i) {
+        Tri q = mesh.GetTri((int)i);
+        const Tri& t = source[i];
+        for (glm::vec3 d : { q.a - t.a, q.b - t.b, q.c - t.c }) {
+            float e = std::max({ std::fabs(d.x), std::fabs(d.y), std::fabs(d.z) });
+            vertErr = std::max(vertErr, e);
+            badVerts += e > 0.5f * mesh.step;
+        }
+    }
+
+    size_t badHeights = 0;
+    float heightErr = 0.0f;
+    std::vector<glm::vec3> samples = FloorCheckSamples(source);
+    for (const auto& p : samples) {
+        float fast = SampleFloorYExact(p), ref = SampleFloorYBrute(source, p);
+        float e = std::fabs(fast - ref);
+        heightErr = std::max(heightErr, e);
+        if (e > FLOOR_LATTICE_MAX_ERROR) {
+            if (badHeights < 8) std::cout << "[FloorLattice] height off at (" << p.x << "," << p.z << "): "
+                << fast << " vs " << ref << "\n";
+            ++badHeights;
+        }
+    }
+    std::cout << "[FloorLattice] verify: lattice " << mesh.step << " m (finest " << TRI_LATTICE_STEP << "), max vertex error "
+        << vertErr << " m (limit " << 0.5f * mesh.step << "), " << badVerts << " vertices over; max height error "
+        << heightErr << " m over " << samples.size() << " samples (limit " << FLOOR_LATTICE_MAX_ERROR << "), "
+        << badHeights << " over\n";
+    return badVerts + badHeights;
+}
+
+// Height-aware wall check
+const float WALL_Y_PAD_DOWN = 0.6f;  // allow a bit of overlap below feet
+const float WALL_Y_PAD_UP = 1.8f;  // wall height that can block (roughly up to chest/head)
+
+inline bool WallBlocksAtHeight(float minY, float maxY, float footY) {
+    return footY >= (minY - WALL_Y_PAD_DOWN) && footY <= (maxY + WALL_Y_PAD_UP);
+}
+
+inline bool IntersectsWallAtHeight(const WallBox& w, const AABB2D& ply, float footY) {
+    if (!WallBlocksAtHeight(w.minY, w.maxY, footY)) return false;
+    return IntersectsXZ(ply, w.boxXZ);
+}
+
+void ResolveStaticWall(const WallBox& w, AABB2D& dynBox, glm::vec3& posXZ) {
+    ResolveStaticXZ(w.boxXZ, dynBox, posXZ);
+}
+
+// ---------- Compact wall boxes ----------
+// Wall bounds as 16-bit offsets from the low corner of all walls, in power-of-two steps per
+// axis just large enough for the map's extent. Bounds round outward, so a decoded box always
+// covers the box it was made from, by at most one step (WALL_BOX_PAD is far wider).
+const float WALL_QUANT_MIN_STEP = 1.0f / 4096.0f;
+
+struct QWallBox { uint16_t x0, z0, x1, z1, y0, y1; };
+
+struct CompactWalls {
+    glm::vec3 origin{ 0.0f }, step{ 1.0f };
+    std::vector<QWallBox> boxes;
+
+    size_t Size() const { return boxes.size(); }
+    size_t MemoryBytes() const { return boxes.size() * sizeof(QWallBox); }
+    void   Build(const std::vector<WallBox>& walls);
+    void   ShiftY(float dy) { origin.y += dy; }
+
+    float   Y(int q) const { return origin.y + q * step.y; }
+    WallBox Get(int i) const { return Decode(boxes[i]); }
+    WallBox Decode(const QWallBox& q) const {
+        float x0 = origin.x + q.x0 * step.x, x1 = origin.x + q.x1 * step.x;
+        float z0 = origin.z + q.z0 * step.z, z1 = origin.z + q.z1 * step.z;
+        return { { { (x0 + x1) * 0.5f, (z0 + z1) * 0.5f }, { (x1 - x0) * 0.5f, (z1 - z0) * 0.5f } }, Y(q.y0), Y(q.y1) };
+    }
+};
+
+void CompactWalls::Build(const std::vector<WallBox>& walls) {
+    *this = CompactWalls();
+    if (walls.empty()) return;
+    auto lowCorner = [](const WallBox& w) { return glm::vec3(w.boxXZ.center.x - w.boxXZ.halfExt.x, w.minY, w.boxXZ.center.y - w.boxXZ.halfExt.y); };
+    auto highCorner = [](const WallBox& w) { return glm::vec3(w.boxXZ.center.x + w.boxXZ.halfExt.x, w.maxY, w.boxXZ.center.y + w.boxXZ.halfExt.y); };
+
+    glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+    for (const WallBox& w : walls) { lo = glm::min(lo, lowCorner(w)); hi = glm::max(hi, highCorner(w)); }
+    origin = lo;
+    for (int a = 0; a < 3; ++a) {
+        step[a] = WALL_QUANT_MIN_STEP;
+        while ((hi[a] - lo[a]) / step[a] > 65534.0f) step[a] *= 2.0f;
+    }
+
+    // the loops settle the rounding of (v - origin) / step against the decode expression
+    auto down = [&](float v, int a) {
+        int q = glm::clamp((int)std::floor((v - origin[a]) / step[a]), 0, 65535);
+        while (q > 0 && origin[a] + q * step[a] > v) --q;
+        return (uint16_t)q;
+    };
+    auto up = [&](float v, int a) {
+        int q = glm::clamp((int)std::ceil((v - origin[a]) / step[a]), 0, 65535);
+        while (q < 65535 && origin[a] + q * step[a] < v) ++q;
+        return (uint16_t)q;
+    };
+    boxes.reserve(walls.size());
+    for (const WallBox& w : walls) {
+        glm::vec3 l = lowCorner(w), h = highCorner(w);
+        boxes.push_back({ down(l.x, 0), down(l.z, 2), up(h.x, 0), up(h.z, 2), down(l.y, 1), up(h.y, 1) });
+    }
+}
+
+// ---------- Wall broadphase (uniform XZ grid) ----------
+const float WALL_GRID_CELL = 2.0f;
+const int   WALL_GRID_MAX_CELLS = 1 << 20;
+
+// CSR layout: walls overlapping cell c are items[cellStart[c] .. cellStart[c+1]).
+// Each cell also keeps the Y range of its walls so whole cells can be skipped by height.
+// Items are copies of the compact boxes, so a cell's walls are one contiguous read; they
+// are decoded as they are visited.
+struct WallGrid {
+    struct CellY { uint16_t y0, y1; };  // in the walls' Y steps, so it moves with them
+
+    glm::vec2 origin{ 0.0f };
+    float cell = WALL_GRID_CELL, invCell = 1.0f / WALL_GRID_CELL;
+    int   nx = 0, nz = 0;
+    std::vector<int>      cellStart;
+    std::vector<QWallBox> items;
+    std::vector<CellY>    cellY;
+
+    void   Build(const CompactWalls& walls);
+    size_t MemoryBytes() const {
+        return cellStart.size() * sizeof(int) + items.size() * sizeof(QWallBox) + cellY.size() * sizeof(CellY);
+    }
+
+    // Calls fn(wall) once for every wall whose XZ box overlaps 'box' and that blocks at 'footY'.
+    // Returning true from fn stops the query early.
+    template <class Fn> bool Query(const CompactWalls& walls, const AABB2D& box, float footY, Fn&& fn) const;
+    // Same, for walls whose own Y range overlaps [minY, maxY] (no step/head padding).
+    template <class Fn> bool QuerySpan(const CompactWalls& walls, const AABB2D& box, float minY, float maxY, Fn&& fn) const;
+
+private:
+    template <class CellOk, class WallOk, class Fn>
+    bool Visit(const CompactWalls& walls, const AABB2D& box, CellOk&& cellOk, WallOk&& wallOk, Fn&& fn) const;
+
+    void CellRange(const AABB2D& b, int& x0, int& z0, int& x1, int& z1) const {
+        x0 = glm::clamp((int)std::floor((b.center.x - b.halfExt.x - origin.x) * invCell), 0, nx - 1);
+        z0 = glm::clamp((int)std::floor((b.center.y - b.halfExt.y - origin.y) * invCell), 0, nz - 1);
+        x1 = glm::clamp((int)std::floor((b.center.x + b.halfExt.x - origin.x) * invCell), 0, nx - 1);
+        z1 = glm::clamp((int)std::floor((b.center.y + b.halfExt.y - origin.y) * invCell), 0, nz - 1);
+    }
+};
+
+void WallGrid::Build(const CompactWalls& walls) {
+    cellStart.clear(); items.clear(); cellY.clear();
+    nx = nz = 0;
+    if (walls.Size() == 0) return;
+
+    std::vector<WallBox> boxes(walls.Size());
+    for (size_t i = 0; i < boxes.size(); ++i) boxes[i] = walls.Get((int)i);
+    glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+    for (const auto& w : boxes) {
+        lo = glm::min(lo, w.boxXZ.center - w.boxXZ.halfExt);
+        hi = glm::max(hi, w.boxXZ.center + w.boxXZ.halfExt);
+    }
+    cell = WALL_GRID_CELL;
+    glm::vec2 ext = hi - lo;
+    while ((double)(ext.x / cell + 1) * (ext.y / cell + 1) > WALL_GRID_MAX_CELLS) cell *= 2.0f;
+    invCell = 1.0f / cell;
+    origin = lo;
+    nx = (int)(ext.x * invCell) + 1;
+    nz = (int)(ext.y * invCell) + 1;
+
+    // two passes: count per cell, then scatter
+    std::vector<int> counts(nx * nz, 0);
+    for (const auto& w : boxes) {
+        int x0, z0, x1, z1; CellRange(w.boxXZ, x0, z0, x1, z1);
+        for (int z = z0; z <= z1; ++z) for (int x = x0; x <= x1; ++x) counts[z * nx + x]++;
+    }
+    cellStart.assign(nx * nz + 1, 0);
+    for (int c = 0; c < nx * nz; ++c) cellStart[c + 1] = cellStart[c] + counts[c];
+    items.resize(cellStart.back());
+    cellY.assign(nx * nz, { 65535, 0 });
+    std::fill(counts.begin(), counts.end(), 0);
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        int x0, z0, x1, z1; CellRange(boxes[i].boxXZ, x0, z0, x1, z1);
+        for (int z = z0; z <= z1; ++z) for (int x = x0; x <= x1; ++x) {
+            int c = z * nx + x;
+            items[cellStart[c] + counts[c]++] = walls.boxes[i];
+            cellY[c].y0 = std::min(cellY[c].y0, walls.boxes[i].y0);
+            cellY[c].y1 = std::max(cellY[c].y1, walls.boxes[i].y1);
+        }
+    }
+}
+
+template <class CellOk, class WallOk, class Fn>
+bool WallGrid::Visit(const CompactWalls& walls, const AABB2D& box, CellOk&& cellOk, WallOk&& wallOk, Fn&& fn) const {
+    if (nx == 0) return false;
+    int x0, z0, x1, z1; CellRange(box, x0, z0, x1, z1);
+    for (int z = z0; z <= z1; ++z) {
+        for (int x = x0; x <= x1; ++x) {
+            int c = z * nx + x;
+            if (!cellOk(walls.Y(cellY[c].y0), walls.Y(cellY[c].y1))) continue;
+            for (int k = cellStart[c]; k < cellStart[c + 1]; ++k) {
+                WallBox w = walls.Decode(items[k]);
+                if (!wallOk(w)) continue;
+                // a wall spanning several cells is only reported from the first cell shared with the query
+                int wx0, wz0, wx1, wz1; CellRange(w.boxXZ, wx0, wz0, wx1, wz1);
+                if (x != std::max(wx0, x0) || z != std::max(wz0, z0)) continue;
+                if (fn(w)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+template <class Fn>
+bool WallGrid::Query(const CompactWalls& walls, const AABB2D& box, float footY, Fn&& fn) const {
+    return Visit(walls, box,
+        [&](float minY, float maxY) { return WallBlocksAtHeight(minY, maxY, footY); },
+        [&](const WallBox& w) { return IntersectsWallAtHeight(w, box, footY); },
+        fn);
+}
+
+template <class Fn>
+bool WallGrid::QuerySpan(const CompactWalls& walls, const AABB2D& box, float minY, float maxY, Fn&& fn) const {
+    return Visit(walls, box,
+        [&](float cellMinY, float cellMaxY) { return cellMinY <= maxY && cellMaxY >= minY; },
+        [&](const WallBox& w) { return w.minY <= maxY && w.maxY >= minY && IntersectsXZ(box, w.boxXZ); },
+        fn);
+}
+
+CompactWalls gWalls;
+WallGrid     gWallGrid;
+
+bool AnyWallAtHeight(const AABB2D& box, float footY) {
+    PROFILE_SCOPE(PROF_WALLS);
+    return gWallGrid.Query(gWalls, box, footY, [](const WallBox&) { return true; });
+}
+
+// One push-out pass against every nearby wall blocking at footY; returns true if anything was resolved.
+bool ResolveWallsAtHeight(AABB2D& box, float footY, glm::vec3& posXZ) {
+    PROFILE_SCOPE(PROF_WALLS);
+    bool any = false;
+    gWallGrid.Query(gWalls, box, footY, [&](const WallBox& w) {
+        ResolveStaticWall(w, box, posXZ); any = true;
+        return false;
+        });
+    return any;
+}
+
+// ---------- Free space ----------
+// Occupancy for placing things. Floor triangles are rasterized at the centers of a FREE_CELL
+// grid into one layer per floor height with headroom, as the navigation grid does, and a
+// layer is occupied when a wall blocks at its height anywhere over the cell's square. Every
+// layer keeps its chessboard distance in cells to the nearest occupied layer, missing floor
+// or height jump, so a box centered on the cell with a half extent under (rings - 0.5) * cell
+// touches no wall. Built with the collider and moved in place with it.
+const float    FREE_CELL = 0.25f;
+const int      FREE_MAX_CELLS = 1 << 22;  // coarser cells beyond this
+const float    FREE_LAYER_MERGE = 0.25f;  // floor hits closer than this on one cell are one layer
+const float    FREE_HEADROOM = 2.0f;      // layers with another floor closer above are dropped
+const float    FREE_JOIN = 0.5f;          // neighbouring layers closer than this are one floor
+const float    FREE_TOP = std::numeric_limits<float>::infinity();  // as footY: the highest layer
+const uint32_t FREE_NONE = 0xFFFFFFFFu;
+
+struct FreeSpaceGrid {
+    glm::vec2 origin{ 0.0f };
+    float cell = FREE_CELL, invCell = 1.0f / FREE_CELL;
+    int   nx = 0, nz = 0;
+    std::vector<uint32_t> cellFirst;   // layers of cell c: [cellFirst[c], cellFirst[c + 1]), lowest first
+    std::vector<float>    layerY;      // floor height at the cell center
+    std::vector<uint16_t> rings;       // 0 when occupied
+
+    bool   Empty() const { return nx == 0; }
+    size_t MemoryBytes() const {
+        return cellFirst.size() * sizeof(uint32_t) + layerY.size() * sizeof(float) + rings.size() * sizeof(uint16_t);
+    }
+    void   Build(const std::vector<Tri>& floors, const CompactWalls& walls);
+    void   ShiftY(float dy) { for (float& y : layerY) y += dy; }
+
+    // Boxes with a smaller half extent fit anywhere in the cell under (x, z), on the layer
+    // closest to footY. 0 when that layer is occupied or there is no floor.
+    float ClearanceAt(float x, float z, float footY) const;
+    // Closest cell center to (x, footY, z) with room for a box of half extent 'radius', at
+    // most maxDist away in XZ. Returns the floor point there.
+    bool  FindFree(float x, float z, float footY, float radius, float maxDist, glm::vec3& out) const;
+
+private:
+    glm::vec2 CellCenter(int cx, int cz) const { return origin + glm::vec2(cx + 0.5f, cz + 0.5f) * cell; }
+    // Layer of cell (cx, cz) closest to footY and no further than tol, or FREE_NONE.
+    uint32_t LayerAt(int cx, int cz, float footY, float tol) const {
+        if (cx < 0 || cz < 0 || cx >= nx || cz >= nz) return FREE_NONE;
+        uint32_t c = (uint32_t)(cz * nx + cx), best = FREE_NONE;
+        if (footY == FREE_TOP) return cellFirst[c] < cellFirst[c + 1] ? cellFirst[c + 1] - 1 : FREE_NONE;
+        for (uint32_t k = cellFirst[c]; k < cellFirst[c + 1]; ++k) {
+            float dy = std::fabs(layerY[k] - footY);
+            if (dy <= tol) { tol = dy; best = k; }
+        }
+        return best;
+    }
+};
+
+void FreeSpaceGrid::Build(const std::vector<Tri>& floors, const CompactWalls& walls) {
+    *this = FreeSpaceGrid();
+    if (floors.empty()) return;
+    glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+    for (const Tri& t : floors) {
+        for (const glm::vec3* p : { &t.a, &t.b, &t.c }) {
+            lo = glm::min(lo, glm::vec2(p->x, p->z));
+            hi = glm::max(hi, glm::vec2(p->x, p->z));
+        }
+    }
+    origin = lo;
+    for (;;) {
+        nx = (int)std::ceil((hi.x - lo.x) * invCell) + 1;
+        nz = (int)std::ceil((hi.y - lo.y) * invCell) + 1;
+        if ((double)nx * nz <= FREE_MAX_CELLS) break;
+        cell *= 2.0f; invCell = 1.0f / cell;
+    }
+
+    // floor heights at cell centers, rasterized twice: count per cell, then fill in cell order
+    std::vector<uint32_t> hitFirst((size_t)nx * nz + 1, 0);
+    std::vector<float> hits;
+    const float EDGE_EPS = -1e-5f;  // shared edges: a center on one counts for both triangles
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const Tri& t : floors) {
+            glm::vec2 a(t.a.x, t.a.z), b(t.b.x, t.b.z), c(t.c.x, t.c.z);
+            float det = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            if (std::fabs(det) < 1e-12f) continue;
+            glm::vec2 tlo = glm::min(a, glm::min(b, c)), thi = glm::max(a, glm::max(b, c));
+            int x0 = std::max(0, (int)std::ceil((tlo.x - origin.x) * invCell - 0.5f));
+            int x1 = std::min(nx - 1, (int)std::floor((thi.x - origin.x) * invCell - 0.5f));
+            int z0 = std::max(0, (int)std::ceil((tlo.y - origin.y) * invCell - 0.5f));
+            int z1 = std::min(nz - 1, (int)std::floor((thi.y - origin.y) * invCell - 0.5f));
+            for (int z = z0; z <= z1; ++z)
+                for (int x = x0; x <= x1; ++x) {
+                    glm::vec2 p = CellCenter(x, z);
+                    float u = ((b.x - p.x) * (c.y - p.y) - (b.y - p.y) * (c.x - p.x)) / det;
+                    float v = ((c.x - p.x) * (a.y - p.y) - (c.y - p.y) * (a.x - p.x)) / det;
+                    float w = 1.0f - u - v;
+                    if (u < EDGE_EPS || v < EDGE_EPS || w < EDGE_EPS) continue;
+                    size_t cell = (size_t)z * nx + x;
+                    if (pass == 0) hitFirst[cell + 1]++;
+                    else hits[hitFirst[cell]++] = u * t.a.y + v * t.b.y + w * t.c.y;
+                }
+        }
+        if (pass == 0) {
+            for (size_t c = 0; c + 1 < hitFirst.size(); ++c) hitFirst[c + 1] += hitFirst[c];
+            hits.resize(hitFirst.back());
+        }
+        else {
+            // the fill moved every start up to the next cell's
+            std::copy_backward(hitFirst.begin(), hitFirst.end() - 1, hitFirst.end());
+            hitFirst[0] = 0;
+        }
+    }
+
+    // layers per cell, lowest first (highest height of each merged run), minus the ones
+    // without headroom
+    cellFirst.assign(hitFirst.size(), 0);
+    layerY.reserve(hits.size());
+    for (size_t c = 0; c + 1 < hitFirst.size(); ++c) {
+        float* h0 = hits.data() + hitFirst[c];
+        float* h1 = hits.data() + hitFirst[c + 1];
+        std::sort(h0, h1);
+        size_t first = layerY.size();
+        for (float* h = h0; h < h1; ++h) {
+            if (layerY.size() > first && *h - layerY.back() <= FREE_LAYER_MERGE) layerY.back() = *h;
+            else layerY.push_back(*h);
+        }
+        size_t kept = first;
+        for (size_t k = first; k < layerY.size(); ++k)
+            if (k + 1 == layerY.size() || layerY[k + 1] - layerY[k] >= FREE_HEADROOM) layerY[kept++] = layerY[k];
+        layerY.resize(kept);
+        cellFirst[c + 1] = (uint32_t)kept;
+    }
+    layerY.shrink_to_fit();
+
+    // occupied layers: every wall marks the cells its box touches, at the heights it blocks
+    const uint16_t FAR = 0xFFFF;
+    rings.assign(layerY.size(), FAR);
+    for (size_t i = 0; i < walls.Size(); ++i) {
+        WallBox w = walls.Get((int)i);
+        glm::vec2 wlo = (w.boxXZ.center - w.boxXZ.halfExt - origin) * invCell;
+        glm::vec2 whi = (w.boxXZ.center + w.boxXZ.halfExt - origin) * invCell;
+        if (whi.x < 0.0f || whi.y < 0.0f || wlo.x >= nx || wlo.y >= nz) continue;
+        int x0 = std::max(0, (int)std::floor(wlo.x)), x1 = std::min(nx - 1, (int)std::floor(whi.x));
+        int z0 = std::max(0, (int)std::floor(wlo.y)), z1 = std::min(nz - 1, (int)std::floor(whi.y));
+        for (int z = z0; z <= z1; ++z)
+            for (int x = x0; x <= x1; ++x) {
+                uint32_t c = (uint32_t)(z * nx + x);
+                for (uint32_t k = cellFirst[c]; k < cellFirst[c + 1]; ++k)
+                    if (WallBlocksAtHeight(w.minY, w.maxY, layerY[k])) rings[k] = 0;
+            }
+    }
+
+    // chessboard distance transform in two raster passes, each relaxing a layer from the four
+    // neighbours already visited; a neighbour without a layer within FREE_JOIN counts as occupied
+    auto ringsNear = [&](int x, int z, float y) -> int {
+        if (x < 0 || z < 0 || x >= nx || z >= nz) return 0;
+        size_t c = (size_t)z * nx + x;
+        int r = 0;
+        float tol = FREE_JOIN;
+        for (uint32_t k = cellFirst[c]; k < cellFirst[c + 1]; ++k) {
+            float dy = std::fabs(layerY[k] - y);
+            if (dy <= tol) { tol = dy; r = rings[k]; }
+        }
+        return r;
+    };
+    static const int FWD[4][2] = { { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+    for (int pass = 0; pass < 2; ++pass) {
+        int sign = pass ? -1 : 1;
+        for (int i = 0; i < nx * nz; ++i) {
+            int c = pass ? nx * nz - 1 - i : i, x = c % nx, z = c / nx;
+            for (uint32_t k = cellFirst[c]; k < cellFirst[c + 1]; ++k) {
+                if (!rings[k]) continue;
+                int r = rings[k];
+                for (const auto& d : FWD) r = std::min(r, ringsNear(x + sign * d[0], z + sign * d[1], layerY[k]) + 1);
+                rings[k] = (uint16_t)std::min(r, FAR - 1);
+            }
+        }
+    }
+}
+
+float FreeSpaceGrid::ClearanceAt(float x, float z, float footY) const {
+    if (Empty()) return 0.0f;
+    uint32_t k = LayerAt((int)std::floor((x - origin.x) * invCell), (int)std::floor((z - origin.y) * invCell),
+                         footY, std::numeric_limits<float>::max());
+    return k == FREE_NONE || !rings[k] ? 0.0f : (rings[k] - 1) * cell;  // the box may sit anywhere in the cell
+}
+
+bool FreeSpaceGrid::FindFree(float x, float z, float footY, float radius, float maxDist, glm::vec3& out) const {
+    if (Empty()) return false;
+    int need = (int)std::floor(std::max(0.0f, radius) * invCell + 0.5f) + 1;  // (rings - 0.5) * cell > radius
+    int cx = (int)std::floor((x - origin.x) * invCell), cz = (int)std::floor((z - origin.y) * invCell);
+    int maxRings = (int)std::ceil(maxDist * invCell + 0.5f);  // last ring that can hold a center within maxDist
+    float best = std::numeric_limits<float>::max(), maxDD = maxDist * maxDist;
+    for (int r = 0; r <= maxRings; ++r) {
+        float reach = (r - 0.5f) * cell;  // no cell center in ring r is closer than this
+        if (r > 0 && reach * reach >= best) break;
+        for (int dz = -r; dz <= r; ++dz) {
+            int gz = cz + dz;
+            if (gz < 0 || gz >= nz) continue;
+            int step = (dz == -r || dz == r) ? 1 : 2 * r;
+            for (int dx = -r; dx <= r; dx += step) {
+                int gx = cx + dx;
+                if (gx < 0 || gx >= nx) continue;
+                uint32_t c = (uint32_t)(gz * nx + gx), k0 = cellFirst[c], k1 = cellFirst[c + 1];
+                if (footY == FREE_TOP && k0 < k1) k0 = k1 - 1;
+                glm::vec2 p = CellCenter(gx, gz), d = p - glm::vec2(x, z);
+                if (glm::dot(d, d) > maxDD) continue;  // ring corners reach past the radius
+                for (uint32_t k = k0; k < k1; ++k) {
+                    if (rings[k] < need) continue;
+                    float dy = footY == FREE_TOP ? 0.0f : layerY[k] - footY;
+                    float dd = glm::dot(d, d) + dy * dy;
+                    if (dd < best) { best = dd; out = { p.x, layerY[k], p.y }; }
+                }
+            }
+        }
+    }
+    return best < std::numeric_limits<float>::max();
+}
+
+FreeSpaceGrid gFreeSpace;
+
+// ---------- Map collider build / incremental update ----------
+// Floor/wall classification only looks at normal.y, which a rotation about Y and a positive
+// uniform scale leave unchanged, so triangles are classified once in map-local space (or come
+// pre-classified from the cook) and every placement change afterwards is a transform of them.
+MapLocalGeometry gMapLocal;
+
+struct NavMesh;  // navigation.h
+
+// A complete collider for one placement; built off-thread and swapped in whole.
+struct MapCollisionWorld {
+    MapPlacement          placement{};
+    CompactWalls          walls;
+    std::vector<Occluder> occluders;
+    TriBVH                bvh;
+    WallGrid              grid;
+    FloorHeightfield      hf;
+    FreeSpaceGrid         free;
+    std::shared_ptr<NavMesh> nav;       // navigation grid over this collider
+    std::vector<Tri>      floorSource;  // float floors in BVH storage order, only when asked for (--verify)
+    size_t                wallTris = 0; // wall boxes before merging
+    double                buildMs = 0.0;
+    // per-stage share of buildMs
+    double                transformMs = 0.0, wallMs = 0.0, bvhMs = 0.0, gridMs = 0.0, freeMs = 0.0, hfMs = 0.0, navMs = 0.0;
+};
+
+MapPlacement gAppliedPlacement{};
+std::future<MapCollisionWorld> gMapRebuildJob;
+uint32_t gColliderBuild = 0;  // bumped per installed collider, for data derived from all of it (navigation)
+
+// The navigation grid is derived from the whole collider, so it is built by the same job right
+// after it and installed with it; the tick never builds one. Defined in simulation.h, which
+// knows the agent it is built for.
+std::shared_ptr<NavMesh> BuildColliderNav(const MapCollisionWorld& w, const std::vector<Tri>& floors);
+void InstallColliderNav(NavMesh& nav);
+
+// Height-aware wall box around world-space bounds (XZ padded)
+const float WALL_BOX_PAD = 0.06f;
+
+WallBox MakeWallBox(const glm::vec3& lo, const glm::vec3& hi) {
+    const float m = WALL_BOX_PAD;
+    float minx = lo.x - m, maxx = hi.x + m;
+    float minz = lo.z - m, maxz = hi.z + m;
+
+    WallBox w;
+    w.boxXZ = { {(minx + maxx) * 0.5f,(minz + maxz) * 0.5f},
+                {(maxx - minx) * 0.5f,(maxz - minz) * 0.5f} };
+    w.minY = lo.y;
+    w.maxY = hi.y;
+    return w;
+}
+
+WallBox MakeWallBox(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    return MakeWallBox(glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)));
+}
+
+// ---------- Wall box merging ----------
+// Tessellated walls produce one box per triangle. Boxes of the same wall plane
+// that touch are merged when the union adds at most WALL_MERGE_TOL square meters
+// of area that no input box covered (so doorways and windows stay open).
+// Set WALL_MERGE_TOL < 0 to keep one box per triangle.
+float WALL_MERGE_TOL = 0.05f;
+const float WALL_MERGE_GAP = 0.02f;          // boxes this close count as touching
+const float WALL_MERGE_FOOTPRINT_SLACK = 0.1f; // max relative growth of the padded XZ footprint
+const float WALL_PLANE_ANGLE_TOL = 0.02f;    // radians, same-plane grouping
+const float WALL_PLANE_DIST_TOL = 0.15f;     // meters, so both faces of a thin wall group together
+const int   WALL_MERGE_MAX_PASSES = 4;
+
+struct WallPiece {
+    glm::vec3 lo, hi;  // unpadded world bounds
+    float tMin, tMax;  // extent along the wall plane
+    float angle, dist; // plane key: folded XZ normal angle and offset
+    glm::vec2 n;       // folded XZ normal
+    float front, back; // triangle area facing along / against n, projected onto the plane
+    float distArea;    // sum of dist * area, for the mean plane offset
+    bool alive;
+};
+
+static float WallPieceArea(float t0, float t1, float y0, float y1) {
+    return std::max(0.0f, t1 - t0) * std::max(0.0f, y1 - y0);
+}
+
+static float PaddedFootprint(const glm::vec3& lo, const glm::vec3& hi) {
+    return (hi.x - lo.x + 2.0f * WALL_BOX_PAD) * (hi.z - lo.z + 2.0f * WALL_BOX_PAD);
+}
+
+// Grows a to cover b when the union stays tight; false leaves a untouched.
+static bool TryMergeWallPieces(WallPiece& a, const WallPiece& b) {
+    const float g = WALL_MERGE_GAP;
+    if (a.lo.x > b.hi.x + g || b.lo.x > a.hi.x + g) return false;
+    if (a.lo.y > b.hi.y + g || b.lo.y > a.hi.y + g) return false;
+    if (a.lo.z > b.hi.z + g || b.lo.z > a.hi.z + g) return false;
+
+    // in-plane area the union would add that neither piece covers
+    float t0 = std::min(a.tMin, b.tMin), t1 = std::max(a.tMax, b.tMax);
+    float y0 = std::min(a.lo.y, b.lo.y), y1 = std::max(a.hi.y, b.hi.y);
+    float covered = WallPieceArea(a.tMin, a.tMax, a.lo.y, a.hi.y)
+                  + WallPieceArea(b.tMin, b.tMax, b.lo.y, b.hi.y)
+                  - WallPieceArea(std::max(a.tMin, b.tMin), std::min(a.tMax, b.tMax),
+                                  std::max(a.lo.y, b.lo.y), std::min(a.hi.y, b.hi.y));
+    if (WallPieceArea(t0, t1, y0, y1) - covered > WALL_MERGE_TOL) return false;
+
+    // diagonal walls: the AABB of the union must not swell into walkable space
+    glm::vec3 lo = glm::min(a.lo, b.lo), hi = glm::max(a.hi, b.hi);
+    float fa = PaddedFootprint(a.lo, a.hi), fb = PaddedFootprint(b.lo, b.hi);
+    if (PaddedFootprint(lo, hi) > (fa + fb) * (1.0f + WALL_MERGE_FOOTPRINT_SLACK)) return false;
+
+    a.lo = lo; a.hi = hi; a.tMin = t0; a.tMax = t1;
+    a.front += b.front; a.back += b.back; a.distArea += b.distArea;
+    return true;
+}
+
+static void MergeWallGroup(std::vector<WallPiece>& p, size_t first, size_t last) {
+    std::sort(p.begin() + first, p.begin() + last,
+              [](const WallPiece& x, const WallPiece& y) { return x.tMin < y.tMin; });
+    for (int pass = 0; pass < WALL_MERGE_MAX_PASSES; ++pass) {
+        bool changed = false;
+        for (size_t i = first; i < last; ++i) {
+            if (!p[i].alive) continue;
+            for (size_t j = i + 1; j < last; ++j) {
+                if (!p[j].alive) continue;
+                if (TryMergeWallPieces(p[i], p[j])) { p[j].alive = false; changed = true; }
+            }
+        }
+        if (!changed) break;
+    }
+}
+
+// ---------- Occluders ----------
+// A merged piece whose triangles fill its plane rectangle on one side is a solid wall and
+// becomes an occluder. Small pieces cost more to rasterize than they hide, and the inset keeps
+// the rectangle inside the real wall so it never hides what shows past an edge.
+const float OCCLUDER_MIN_AREA = 2.0f;   // square meters
+const float OCCLUDER_MIN_FILL = 0.98f;  // covered share of the rectangle
+const float OCCLUDER_INSET = 0.05f;     // meters, from every edge
+
+static bool MakeOccluder(const WallPiece& w, Occluder& o) {
+    float t0 = w.tMin + OCCLUDER_INSET, t1 = w.tMax - OCCLUDER_INSET;
+    float y0 = w.lo.y + OCCLUDER_INSET, y1 = w.hi.y - OCCLUDER_INSET;
+    float rect = WallPieceArea(w.tMin, w.tMax, w.lo.y, w.hi.y);
+    if (t1 <= t0 || y1 <= y0 || rect < OCCLUDER_MIN_AREA) return false;
+    if (std::max(w.front, w.back) < OCCLUDER_MIN_FILL * rect) return false;
+
+    glm::vec2 tan(-w.n.y, w.n.x);
+    glm::vec2 base = w.n * (w.distArea / (w.front + w.back));  // both faces of a thin wall: inside it
+    glm::vec2 a = base + tan * t0, b = base + tan * t1;
+    o.v[0] = { a.x, y0, a.y };
+    o.v[1] = { b.x, y0, b.y };
+    o.v[2] = { b.x, y1, b.y };
+    o.v[3] = { a.x, y1, a.y };
+    return true;
+}
+
+// World-space wall triangles -> merged height-aware boxes, plus occluders when asked for
+// (none when merging is off).
+std::vector<WallBox> BuildWallBoxes(const std::vector<Tri>& wallTris, std::vector<Occluder>* occluders = nullptr) {
+    std::vector<WallBox> out;
+    if (WALL_MERGE_TOL < 0.0f) {
+        out.reserve(wallTris.size());
+        for (const Tri& t : wallTris) out.push_back(MakeWallBox(t.a, t.b, t.c));
+        return out;
+    }
+
+    const float PI = 3.14159265f;
+    std::vector<WallPiece> p;
+    p.reserve(wallTris.size());
+    for (const Tri& t : wallTris) {
+        glm::vec2 n(t.n.x, t.n.z);
+        float len = glm::length(n);
+        n = len > 1e-6f ? n / len : glm::vec2(1, 0);
+        // front and back faces share a plane group
+        bool facing = true;
+        if (n.y < 0.0f || (n.y == 0.0f && n.x < 0.0f)) { n = -n; facing = false; }
+        // fold the seam at +-x: the normal flips with the angle, so the plane offset, tangent
+        // range and facing match pieces of the same plane on the other side of it
+        float angle = std::atan2(n.y, n.x);
+        if (angle >= PI - WALL_PLANE_ANGLE_TOL) { angle -= PI; n = -n; facing = !facing; }
+        glm::vec2 tan(-n.y, n.x);
+        glm::vec2 c = (glm::vec2(t.a.x, t.a.z) + glm::vec2(t.b.x, t.b.z) + glm::vec2(t.c.x, t.c.z)) / 3.0f;
+
+        WallPiece w;
+        w.lo = glm::min(t.a, glm::min(t.b, t.c));
+        w.hi = glm::max(t.a, glm::max(t.b, t.c));
+        float ta = glm::dot(tan, glm::vec2(t.a.x, t.a.z));
+        float tb = glm::dot(tan, glm::vec2(t.b.x, t.b.z));
+        float tc = glm::dot(tan, glm::vec2(t.c.x, t.c.z));
+        w.tMin = std::min({ ta, tb, tc });
+        w.tMax = std::max({ ta, tb, tc });
+        w.angle = angle;
+        w.dist = glm::dot(n, c);
+        w.n = n;
+        float area = 0.5f * std::fabs((tb - ta) * (t.c.y - t.a.y) - (tc - ta) * (t.b.y - t.a.y));
+        w.front = facing ? area : 0.0f;
+        w.back = facing ? 0.0f : area;
+        w.distArea = w.dist * area;
+        w.alive = true;
+        p.push_back(w);
+    }
+
+    // group by angle, then by plane offset; groups split where sorted keys jump
+    std::sort(p.begin(), p.end(), [](const WallPiece& x, const WallPiece& y) { return x.angle < y.angle; });
+    for (size_t a0 = 0; a0 < p.size();) {
+        size_t a1 = a0 + 1;
+        while (a1 < p.size() && p[a1].angle - p[a1 - 1].angle <= WALL_PLANE_ANGLE_TOL) ++a1;
+
+        std::sort(p.begin() + a0, p.begin() + a1, [](const WallPiece& x, const WallPiece& y) { return x.dist < y.dist; });
+        for (size_t d0 = a0; d0 < a1;) {
+            size_t d1 = d0 + 1;
+            while (d1 < a1 && p[d1].dist - p[d1 - 1].dist <= WALL_PLANE_DIST_TOL) ++d1;
+            MergeWallGroup(p, d0, d1);
+            d0 = d1;
+        }
+        a0 = a1;
+    }
+
+    Occluder o;
+    for (const WallPiece& w : p) {
+        if (!w.alive) continue;
+        out.push_back(MakeWallBox(w.lo, w.hi));
+        if (occluders && MakeOccluder(w, o)) occluders->push_back(o);
+    }
+    return out;
+}
+
+// Pure function of its inputs so it can run on a worker thread. The triangle transform
+// is split over the pool; the rest of the stages are serial.
+const size_t TRANSFORM_GRAIN = 8192;
+
+MapCollisionWorld BuildCollisionWorld(const MapLocalGeometry& local, MapPlacement placement, bool withHeightfield,
+                                      bool keepFloorSource = false) {
+    using clock = std::chrono::steady_clock;
+    auto t0 = clock::now(), stage = t0;
+    auto lap = [&stage]() {
+        auto now = clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - stage).count();
+        stage = now;
+        return ms;
+    };
+    MapCollisionWorld w;
+    w.placement = placement;
+
+    glm::mat4 T = MapTransform(placement);
+    glm::mat3 R(T);
+    auto xf = [&](const glm::vec3& p) { return glm::vec3(T * glm::vec4(p, 1.0f)); };
+
+    std::vector<Tri> floorTris(local.floorTris.size());
+    ParallelFor(local.floorTris.size(), TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Tri& t = local.floorTris[i];
+            floorTris[i] = { xf(t.a), xf(t.b), xf(t.c), glm::normalize(R * t.n) };
+        }
+        });
+    std::vector<Tri> wallTris(local.wallTris.size());
+    ParallelFor(local.wallTris.size(), TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Tri& t = local.wallTris[i];
+            wallTris[i] = { xf(t.a), xf(t.b), xf(t.c), R * t.n };
+        }
+        });
+    w.transformMs = lap();
+    w.walls.Build(BuildWallBoxes(wallTris, &w.occluders));
+    w.wallTris = wallTris.size();
+    w.wallMs = lap();
+
+    w.bvh.Build(floorTris, keepFloorSource ? &w.floorSource : nullptr);
+    w.bvhMs = lap();
+    w.grid.Build(w.walls);
+    w.gridMs = lap();
+    std::vector<Tri> floors = w.bvh.mesh.Decode();  // as the BVH stores them, so heights agree
+    w.free.Build(floors, w.walls);
+    w.freeMs = lap();
+    if (withHeightfield) w.hf.Build(floors, HF_CELL);
+    w.hfMs = lap();
+    w.nav = BuildColliderNav(w, floors);
+    w.navMs = lap();
+    w.buildMs = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+    return w;
+}
+
+void InstallCollisionWorld(MapCollisionWorld& w) {
+    std::swap(gWalls, w.walls);
+    gOccluders.swap(w.occluders);
+    std::swap(gFloorBVH, w.bvh);
+    std::swap(gWallGrid, w.grid);
+    std::swap(gFloorHF, w.hf);
+    std::swap(gFreeSpace, w.free);
+    gAppliedPlacement = w.placement;
+    ++gColliderBuild;
+    InstallColliderNav(*w.nav);
+    InvalidateFloorQueries();
+
+    std::cout << "[MapCollider] floors=" << gFloorBVH.mesh.Size()
+        << " walls=" << gWalls.Size() << " (from " << w.wallTris << " tris)" << " occluders=" << gOccluders.size() << " bvhNodes=" << gFloorBVH.nodes.size()
+        << " wallGrid=" << gWallGrid.nx << "x" << gWallGrid.nz
+        << " floorMem=" << gFloorBVH.MemoryBytes() / 1024 << "KB wallMem=" << (gWalls.MemoryBytes() + gWallGrid.MemoryBytes()) / 1024 << "KB"
+        << " freeSpace=" << gFreeSpace.nx << "x" << gFreeSpace.nz << "@" << gFreeSpace.cell << " freeMem=" << gFreeSpace.MemoryBytes() / 1024 << "KB"
+        << " lattice=" << gFloorBVH.mesh.step
+        << " triKernel=" << gTriKernel.name << " build=" << w.buildMs << "ms\n";
+    if (!gFloorHF.Empty()) ReportFloorHeightfield(w.buildMs);
+}
+
+// Full synchronous build, used at startup. Takes over the map's local collision lists.
+void BuildMapCollision(ModelData& map) {
+    gMapLocal = map.collision.Empty() ? ClassifyMapLocal(map) : std::move(map.collision);
+    MapCollisionWorld w = BuildCollisionWorld(gMapLocal, CurrentMapPlacement(), gUseHeightfield);
+    InstallCollisionWorld(w);
+}
+
+// A pure height change to yOffset: move everything in place and refit the BVH, no rebuild.
+// The applied offset takes the target value, so repeated shifts never drift away from it.
+void ShiftMapCollisionY(float yOffset) {
+    float dy = yOffset - gAppliedPlacement.yOffset;
+    gFloorBVH.ShiftY(dy);
+    gWalls.ShiftY(dy);  // the wall grid's cell heights are stored relative to the walls
+    for (Occluder& o : gOccluders) for (glm::vec3& v : o.v) v.y += dy;
+    gFloorHF.ShiftY(dy);
+    gFreeSpace.ShiftY(dy);
+    gAppliedPlacement.yOffset = yOffset;
+    InvalidateFloorQueries();
+}
+
+// Bring the collider in line with the current map placement. Y offset changes are applied
+// immediately; scale/yaw changes rebuild on a worker thread while the old collider stays live.
+// Returns true once the collider matches the current placement.
+bool UpdateMapCollision() {
+    PROFILE_SCOPE(PROF_COLLIDER);
+    if (gMapRebuildJob.valid()) {
+        if (gMapRebuildJob.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+        MapCollisionWorld w = gMapRebuildJob.get();
+        InstallCollisionWorld(w);
+    }
+
+    MapPlacement cur = CurrentMapPlacement();
+    if (cur.SameShape(gAppliedPlacement)) {
+        if (cur.yOffset != gAppliedPlacement.yOffset) {
+            ShiftMapCollisionY(cur.yOffset);
+        }
+        return true;
+    }
+    bool withHF = gUseHeightfield;
+    gMapRebuildJob = gWorkers.Submit([cur, withHF] { return BuildCollisionWorld(gMapLocal, cur, withHF); });
+    return false;
+}
+
+// Startup path: take over the map's local lists and build the world collider on a worker;
+// UpdateMapCollision installs it once it is done.
+void StartMapCollisionBuild(ModelData& map) {
+    gMapLocal = map.collision.Empty() ? ClassifyMapLocal(map) : std::move(map.collision);
+    MapPlacement cur = CurrentMapPlacement();
+    bool withHF = gUseHeightfield;
+    gMapRebuildJob = gWorkers.Submit([cur, withHF] { return BuildCollisionWorld(gMapLocal, cur, withHF); });
+}
+
+#endif
@@ -0,0 +1,745 @@
+// CPU-side model data: OBJ import through Assimp, the cooked (.cook) cache and the
+// floor/wall triangle split the colliders are built from. No GL in here.
+// Header-only: include it from one translation unit per executable.
+#ifndef MODEL_DATA_H
+#define MODEL_DATA_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "worker_pool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// ---------- Map triangles ----------
+struct Tri { glm::vec3 a, b, c; glm::vec3 n; };
+
+const float FLOOR_MIN_NY = 0.55f; // treat tri as floor if normal.y >= this
+const float WALL_MAX_NY = 0.25f; // treat tri as wall if |normal.y| <= this
+
+// ---------- Model data (CPU side) ----------
+// Geometry as the importer or a cooked file hands it over, before anything touches GL.
+// Arrays are views: they point either into owned vectors (fresh OBJ import) or straight into
+// a read-only mapping of the cooked file.
+struct PackedVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+template <class T> struct ArrayView {
+    const T* data = nullptr;
+    size_t   count = 0;
+    const T* begin() const { return data; }
+    const T* end() const { return data + count; }
+    size_t   size() const { return count; }
+    bool     empty() const { return count == 0; }
+    const T& operator[](size_t i) const { return data[i]; }
+};
+
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t         size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::string& path) {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file, &sz) || sz.QuadPart == 0) { Close(); return false; }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) { Close(); return false; }
+        data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)sz.QuadPart;
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { Close(); return false; }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { Close(); return false; }
+        data = (const uint8_t*)p;
+        size = (size_t)st.st_size;
+#endif
+        return data != nullptr;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr; file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+        if (fd >= 0) close(fd);
+        fd = -1;
+#endif
+        data = nullptr; size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Map triangles classified in map-local space (see BuildCollisionWorld). Views into either
+// the owned vectors or a cooked file mapping kept alive by 'backing'.
+struct MapLocalGeometry {
+    ArrayView<Tri> floorTris;
+    ArrayView<Tri> wallTris;
+    std::vector<Tri> ownedFloor, ownedWall;
+    std::shared_ptr<const MappedFile> backing;
+
+    MapLocalGeometry() = default;
+    MapLocalGeometry(MapLocalGeometry&&) = default;              // vector moves keep the views valid
+    MapLocalGeometry& operator=(MapLocalGeometry&&) = default;
+    MapLocalGeometry(const MapLocalGeometry&) = delete;
+    MapLocalGeometry& operator=(const MapLocalGeometry&) = delete;
+
+    bool Empty() const { return floorTris.empty() && wallTris.empty(); }
+    void Adopt(std::vector<Tri> floor, std::vector<Tri> wall) {
+        ownedFloor = std::move(floor); ownedWall = std::move(wall); backing.reset();
+        floorTris = { ownedFloor.data(), ownedFloor.size() };
+        wallTris = { ownedWall.data(), ownedWall.size() };
+    }
+};
+
+struct MeshTextureRef { std::string type, path; };
+
+// A contiguous index range of one mesh plus its mesh-local bounds, the unit the renderer culls.
+struct MeshChunk {
+    uint32_t  firstIndex, indexCount;
+    glm::vec3 bmin, bmax;
+};
+
+struct MeshData {
+    ArrayView<PackedVertex> vertices;
+    ArrayView<uint32_t>     indices;
+    ArrayView<MeshChunk>    chunks;     // cover all indices; empty only for hand-built meshes
+    std::vector<MeshTextureRef> textures;
+};
+
+struct ModelData {
+    std::string source;                 // OBJ path
+    std::string directory;              // texture lookups are relative to this
+    std::vector<MeshData> meshes;
+    MapLocalGeometry collision;         // only filled for models loaded with collision
+    bool cooked = false;
+
+    // storage behind the views above
+    std::vector<std::vector<PackedVertex>> ownedVertices;
+    std::vector<std::vector<uint32_t>>     ownedIndices;
+    std::vector<std::vector<MeshChunk>>    ownedChunks;
+    std::shared_ptr<const MappedFile>      mapping;
+};
+
+// ---------- Draw chunks ----------
+// Meshes above CHUNK_MAX_TRIS are cut into spatially compact chunks so the renderer can cull
+// parts of one big mesh: triangles are reordered by the Morton code of their centroid within
+// the mesh bounds, then every CHUNK_MAX_TRIS consecutive triangles form a chunk. Done once at
+// import; the reordered indices and the chunk table are stored in the cook.
+const uint32_t CHUNK_MAX_TRIS = 2048;
+
+static inline uint32_t SpreadBits10(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+std::vector<MeshChunk> BuildDrawChunks(ArrayView<PackedVertex> V, std::vector<uint32_t>& I) {
+    std::vector<MeshChunk> chunks;
+    size_t triCount = I.size() / 3;
+    if (triCount == 0) return chunks;
+
+    glm::vec3 bmin(std::numeric_limits<float>::max()), bmax(-std::numeric_limits<float>::max());
+    for (uint32_t i : I) { bmin = glm::min(bmin, V[i].Position); bmax = glm::max(bmax, V[i].Position); }
+
+    if (triCount > CHUNK_MAX_TRIS) {
+        glm::vec3 scale = 1023.0f / glm::max(bmax - bmin, glm::vec3(1e-6f));
+        std::vector<uint64_t> keys(triCount);  // morton << 32 | triangle
+        for (size_t t = 0; t < triCount; ++t) {
+            glm::vec3 c = (V[I[t * 3]].Position + V[I[t * 3 + 1]].Position + V[I[t * 3 + 2]].Position) * (1.0f / 3.0f);
+            glm::vec3 q = glm::clamp((c - bmin) * scale, glm::vec3(0.0f), glm::vec3(1023.0f));
+            uint32_t code = SpreadBits10((uint32_t)q.x) | (SpreadBits10((uint32_t)q.y) << 1) | (SpreadBits10((uint32_t)q.z) << 2);
+            keys[t] = ((uint64_t)code << 32) | t;
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<uint32_t> sorted(I.size());
+        for (size_t t = 0; t < triCount; ++t) {
+            size_t src = (keys[t] & 0xffffffffu) * 3;
+            sorted[t * 3 + 0] = I[src + 0]; sorted[t * 3 + 1] = I[src + 1]; sorted[t * 3 + 2] = I[src + 2];
+        }
+        I.swap(sorted);
+    }
+
+    for (size_t first = 0; first < triCount; first += CHUNK_MAX_TRIS) {
+        size_t last = std::min(triCount, first + CHUNK_MAX_TRIS);
+        MeshChunk c{ (uint32_t)(first * 3), (uint32_t)((last - first) * 3), glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+        for (size_t k = first * 3; k < last * 3; ++k) { c.bmin = glm::min(c.bmin, V[I[k]].Position); c.bmax = glm::max(c.bmax, V[I[k]].Position); }
+        chunks.push_back(c);
+    }
+    return chunks;
+}
+
+// ---------- GPU mesh optimization ----------
+// Run at import after the draw chunks are cut, so the cook stores the result. Within each chunk
+// (the chunk table stays valid) triangles are reordered with Tipsify (Sander, Nehab & Barczak
+// 2007) for post-transform cache reuse. The clusters it produces are then sorted
+// outward-facing first to cut overdraw. Finally, the vertices of the whole mesh are
+// renumbered in first-use order so fetches walk the buffer forwards.
+const uint32_t VCACHE_SIZE = 16;                 // FIFO size Tipsify targets and the ACMR stat simulates
+const uint32_t OVERDRAW_MIN_CLUSTER_TRIS = 32;   // smaller Tipsify clusters are merged with the next one
+const size_t   FETCH_LINE_BYTES = 64, FETCH_CACHE_LINES = 64;
+
+// ACMR = vertex transforms per triangle, ATVR = per referenced vertex (1.0 is ideal),
+// overfetch = bytes read through the fetch cache per referenced vertex byte (1.0 is ideal).
+struct MeshOptStats {
+    uint64_t tris = 0, vertices = 0;
+    uint64_t transformsBefore = 0, transformsAfter = 0;
+    uint64_t fetchBefore = 0, fetchAfter = 0;   // bytes
+
+    void Add(const MeshOptStats& o) {
+        tris += o.tris; vertices += o.vertices;
+        transformsBefore += o.transformsBefore; transformsAfter += o.transformsAfter;
+        fetchBefore += o.fetchBefore; fetchAfter += o.fetchAfter;
+    }
+};
+
+// Misses of a FIFO post-transform cache of VCACHE_SIZE entries. A vertex is cached while fewer
+// than VCACHE_SIZE others have entered since it did.
+static uint64_t SimulateVertexCache(const std::vector<uint32_t>& I, size_t vertexCount) {
+    std::vector<uint32_t> entered(vertexCount, 0);
+    uint32_t time = VCACHE_SIZE + 1;
+    uint64_t misses = 0;
+    for (uint32_t v : I)
+        if (time - entered[v] > VCACHE_SIZE) { entered[v] = time++; ++misses; }
+    return misses;
+}
+
+// Bytes read through a small direct-mapped cache of FETCH_CACHE_LINES lines.
+static uint64_t SimulateVertexFetch(const std::vector<uint32_t>& I) {
+    std::vector<uint64_t> lines(FETCH_CACHE_LINES, std::numeric_limits<uint64_t>::max());
+    uint64_t bytes = 0;
+    for (uint32_t v : I) {
+        uint64_t first = (uint64_t)v * sizeof(PackedVertex) / FETCH_LINE_BYTES;
+        uint64_t last = ((uint64_t)v * sizeof(PackedVertex) + sizeof(PackedVertex) - 1) / FETCH_LINE_BYTES;
+        for (uint64_t l = first; l <= last; ++l) {
+            uint64_t& slot = lines[l % FETCH_CACHE_LINES];
+            if (slot != l) { slot = l; bytes += FETCH_LINE_BYTES; }
+        }
+    }
+    return bytes;
+}
+
+static uint64_t ReferencedVertices(const std::vector<uint32_t>& I, size_t vertexCount) {
+    std::vector<bool> used(vertexCount, false);
+    uint64_t n = 0;
+    for (uint32_t v : I) if (!used[v]) { used[v] = true; ++n; }
+    return n;
+}
+
+void ReportMeshOpt(const std::string& name, const MeshOptStats& s, double ms) {
+    if (s.tris == 0) return;
+    double tris = (double)s.tris, verts = (double)std::max<uint64_t>(1, s.vertices), bytes = verts * sizeof(PackedVertex);
+    std::cout << "[MeshOpt] " << name << ": ACMR " << s.transformsBefore / tris << " -> " << s.transformsAfter / tris
+        << ", ATVR " << s.transformsBefore / verts << " -> " << s.transformsAfter / verts
+        << ", overfetch " << s.fetchBefore / bytes << " -> " << s.fetchAfter / bytes
+        << " (" << s.tris << " tris, " << ms << " ms)\n";
+}
+
+// Tipsify over one chunk in chunk-local vertex ids [0, vertexCount). Appends the new triangle
+// order to 'order' (chunk-local triangle ids) and the position in 'order' where each cluster
+// starts. A cluster ends where the fan runs into a dead end and has to restart elsewhere.
+static void TipsifyChunk(const std::vector<uint32_t>& I, uint32_t vertexCount,
+                         std::vector<uint32_t>& order, std::vector<uint32_t>& clusterStarts) {
+    uint32_t triCount = (uint32_t)(I.size() / 3);
+    std::vector<uint32_t> adjStart(vertexCount + 1, 0), adj(I.size()), live(vertexCount, 0);
+    for (uint32_t v : I) { adjStart[v + 1]++; live[v]++; }
+    for (uint32_t v = 0; v < vertexCount; ++v) adjStart[v + 1] += adjStart[v];
+    {
+        std::vector<uint32_t> fill(adjStart.begin(), adjStart.end() - 1);
+        for (uint32_t k = 0; k < I.size(); ++k) adj[fill[I[k]]++] = k / 3;
+    }
+
+    std::vector<uint32_t> entered(vertexCount, 0), deadEnd, candidates;
+    std::vector<bool> emitted(triCount, false);
+    uint32_t time = VCACHE_SIZE + 1, cursor = 0;
+    int64_t fan = 0;
+    clusterStarts.push_back((uint32_t)order.size());
+    while (fan >= 0) {
+        candidates.clear();
+        for (uint32_t a = adjStart[fan]; a < adjStart[fan + 1]; ++a) {
+            uint32_t t = adj[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            order.push_back(t);
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = I[t * 3 + k];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - entered[v] > VCACHE_SIZE) entered[v] = time++;
+            }
+        }
+
+        // Next fan: the candidate that has been in the cache longest and won't fall out
+        // before its remaining triangles are emitted; any live candidate beats none.
+        int64_t best = -1, bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            int64_t priority = 0;
+            if (time - entered[v] + 2 * live[v] <= VCACHE_SIZE) priority = time - entered[v];
+            if (priority > bestPriority) { bestPriority = priority; best = v; }
+        }
+        if (best < 0) {
+            while (!deadEnd.empty() && best < 0) {
+                uint32_t v = deadEnd.back(); deadEnd.pop_back();
+                if (live[v] > 0) best = v;
+            }
+            while (best < 0 && cursor < vertexCount) {
+                if (live[cursor] > 0) best = cursor;
+                else ++cursor;
+            }
+            if (best >= 0) clusterStarts.push_back((uint32_t)order.size());
+        }
+        fan = best;
+    }
+}
+
+// Reorders I within every chunk and then V in first-use order; chunk ranges and bounds stay valid.
+void OptimizeMeshForGpu(std::vector<PackedVertex>& V, std::vector<uint32_t>& I, const std::vector<MeshChunk>& chunks) {
+    std::vector<uint32_t> localId(V.size(), std::numeric_limits<uint32_t>::max()), globalId;
+    std::vector<uint32_t> local, order, starts, out;
+    for (const MeshChunk& c : chunks) {
+        // chunk-local vertex ids in first-use order
+        globalId.clear(); local.clear();
+        for (uint32_t k = c.firstIndex; k < c.firstIndex + c.indexCount; ++k) {
+            uint32_t v = I[k];
+            if (localId[v] == std::numeric_limits<uint32_t>::max()) { localId[v] = (uint32_t)globalId.size(); globalId.push_back(v); }
+            local.push_back(localId[v]);
+        }
+        order.clear(); starts.clear();
+        TipsifyChunk(local, (uint32_t)globalId.size(), order, starts);
+        starts.push_back((uint32_t)order.size());
+
+        // Clusters facing away from the chunk centre are drawn first: they tend to occlude
+        // the rest when seen from outside (Sander et al., sec. 4).
+        auto triCentroid = [&](uint32_t t) {
+            return (V[globalId[local[t * 3]]].Position + V[globalId[local[t * 3 + 1]]].Position + V[globalId[local[t * 3 + 2]]].Position) * (1.0f / 3.0f);
+        };
+        glm::vec3 centre(0.0f);
+        for (uint32_t t : order) centre += triCentroid(t);
+        centre /= (float)std::max<size_t>(1, order.size());
+
+        struct Cluster { uint32_t begin, end; float key; };
+        std::vector<Cluster> clusters;
+        for (size_t k = 0; k + 1 < starts.size(); ++k) {
+            if (!clusters.empty() && clusters.back().end - clusters.back().begin < OVERDRAW_MIN_CLUSTER_TRIS) clusters.back().end = starts[k + 1];
+            else clusters.push_back({ starts[k], starts[k + 1], 0.0f });
+        }
+        for (Cluster& cl : clusters) {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            for (uint32_t k = cl.begin; k < cl.end; ++k) {
+                uint32_t t = order[k];
+                glm::vec3 a = V[globalId[local[t * 3]]].Position, b = V[globalId[local[t * 3 + 1]]].Position, d = V[globalId[local[t * 3 + 2]]].Position;
+                centroid += (a + b + d) * (1.0f / 3.0f);
+                normal += glm::cross(b - a, d - a);   // area-weighted
+            }
+            centroid /= (float)(cl.end - cl.begin);
+            float len = glm::length(normal);
+            cl.key = len > 0.0f ? glm::dot(centroid - centre, normal / len) : 0.0f;
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& x, const Cluster& y) { return x.key > y.key; });
+
+        out.clear();
+        for (const Cluster& cl : clusters)
+            for (uint32_t k = cl.begin; k < cl.end; ++k)
+                for (int j = 0; j < 3; ++j) out.push_back(globalId[local[order[k] * 3 + j]]);
+        std::copy(out.begin(), out.end(), I.begin() + c.firstIndex);
+        for (uint32_t v : globalId) localId[v] = std::numeric_limits<uint32_t>::max();
+    }
+
+    // Vertex fetch: renumber in first-use order; unreferenced vertices go last.
+    std::vector<uint32_t> remap(V.size(), std::numeric_limits<uint32_t>::max());
+    uint32_t next = 0;
+    for (uint32_t& v : I) {
+        if (remap[v] == std::numeric_limits<uint32_t>::max()) remap[v] = next++;
+        v = remap[v];
+    }
+    for (uint32_t& r : remap) if (r == std::numeric_limits<uint32_t>::max()) r = next++;
+    std::vector<PackedVertex> sorted(V.size());
+    for (size_t v = 0; v < V.size(); ++v) sorted[remap[v]] = V[v];
+    V.swap(sorted);
+}
+
+// Same scene walk as LearnOpenGL's Model::loadModel, minus the GL calls.
+bool ImportModelObj(const std::string& path, ModelData& out) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << "\n";
+        return false;
+    }
+    out.source = path;
+    out.directory = path.substr(0, path.find_last_of('/'));
+
+    auto addTextures = [&](const aiMaterial* mat, aiTextureType type, const char* typeName, MeshData& md) {
+        for (unsigned int i = 0; i < mat->GetTextureCount(type); ++i) {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            md.textures.push_back({ typeName, str.C_Str() });
+        }
+    };
+
+    MeshOptStats meshOpt;
+    double meshOptMs = 0.0;
+    std::vector<const aiNode*> stack{ scene->mRootNode };
+    while (!stack.empty()) {
+        const aiNode* node = stack.back(); stack.pop_back();
+        for (unsigned int m = 0; m < node->mNumMeshes; ++m) {
+            const aiMesh* mesh = scene->mMeshes[node->mMeshes[m]];
+            std::vector<PackedVertex> V(mesh->mNumVertices);
+            for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+                V[i].Position = { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z };
+                V[i].Normal = mesh->mNormals ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) : glm::vec3(0.0f);
+                V[i].TexCoords = mesh->mTextureCoords[0] ? glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y) : glm::vec2(0.0f);
+            }
+            std::vector<uint32_t> I;
+            I.reserve(mesh->mNumFaces * 3);
+            for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+                for (unsigned int k = 0; k < mesh->mFaces[f].mNumIndices; ++k) I.push_back(mesh->mFaces[f].mIndices[k]);
+
+            MeshData md;
+            const aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
+            addTextures(mat, aiTextureType_DIFFUSE, "texture_diffuse", md);
+            addTextures(mat, aiTextureType_SPECULAR, "texture_specular", md);
+            addTextures(mat, aiTextureType_HEIGHT, "texture_normal", md);
+            addTextures(mat, aiTextureType_AMBIENT, "texture_height", md);
+
+            MeshOptStats ms;
+            ms.tris = I.size() / 3;
+            ms.vertices = ReferencedVertices(I, V.size());
+            ms.transformsBefore = SimulateVertexCache(I, V.size());
+            ms.fetchBefore = SimulateVertexFetch(I);
+            std::vector<MeshChunk> chunks = BuildDrawChunks({ V.data(), V.size() }, I);
+            auto optStart = std::chrono::steady_clock::now();
+            OptimizeMeshForGpu(V, I, chunks);
+            meshOptMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - optStart).count();
+            ms.transformsAfter = SimulateVertexCache(I, V.size());
+            ms.fetchAfter = SimulateVertexFetch(I);
+            meshOpt.Add(ms);
+
+            out.ownedVertices.push_back(std::move(V));
+            md.vertices = { out.ownedVertices.back().data(), out.ownedVertices.back().size() };
+            out.ownedChunks.push_back(std::move(chunks));
+            out.ownedIndices.push_back(std::move(I));
+            md.indices = { out.ownedIndices.back().data(), out.ownedIndices.back().size() };
+            md.chunks = { out.ownedChunks.back().data(), out.ownedChunks.back().size() };
+            out.meshes.push_back(std::move(md));
+        }
+        // push children in reverse so meshes come out in the same order as the recursive walk
+        for (unsigned int c = node->mNumChildren; c-- > 0;) stack.push_back(node->mChildren[c]);
+    }
+    ReportMeshOpt(path.substr(path.find_last_of('/') + 1), meshOpt, meshOptMs);
+    return true;
+}
+
+// Floor/wall split in map-local space; see the collider build for why that is enough.
+// Meshes are cut into pieces of at most CLASSIFY_PIECE_TRIS triangles that are classified
+// in parallel and concatenated in order, so the lists match a serial pass exactly.
+const size_t CLASSIFY_PIECE_TRIS = 4096;
+
+MapLocalGeometry ClassifyMapLocal(const ModelData& map) {
+    struct Piece { const MeshData* mesh; size_t firstTri, endTri; std::vector<Tri> floor, wall; };
+    std::vector<Piece> pieces;
+    for (const auto& mesh : map.meshes) {
+        if (mesh.indices.empty() || mesh.vertices.empty()) continue;
+        size_t tris = mesh.indices.size() / 3;
+        for (size_t t = 0; t < tris; t += CLASSIFY_PIECE_TRIS)
+            pieces.push_back({ &mesh, t, std::min(tris, t + CLASSIFY_PIECE_TRIS), {}, {} });
+    }
+
+    ParallelFor(pieces.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+            Piece& piece = pieces[p];
+            const auto& V = piece.mesh->vertices;
+            const auto& I = piece.mesh->indices;
+            for (size_t i = piece.firstTri * 3; i < piece.endTri * 3; i += 3) {
+                glm::vec3 a = V[I[i + 0]].Position;
+                glm::vec3 b = V[I[i + 1]].Position;
+                glm::vec3 c = V[I[i + 2]].Position;
+                glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+                float ny = std::abs(n.y);
+
+                if (n.y >= FLOOR_MIN_NY) piece.floor.push_back({ a,b,c,n });
+                else if (ny <= WALL_MAX_NY) piece.wall.push_back({ a,b,c,n });
+            }
+        }
+        });
+
+    std::vector<Tri> floor, wall;
+    size_t floorCount = 0, wallCount = 0;
+    for (const Piece& p : pieces) { floorCount += p.floor.size(); wallCount += p.wall.size(); }
+    floor.reserve(floorCount); wall.reserve(wallCount);
+    for (const Piece& p : pieces) {
+        floor.insert(floor.end(), p.floor.begin(), p.floor.end());
+        wall.insert(wall.end(), p.wall.begin(), p.wall.end());
+    }
+    MapLocalGeometry local;
+    local.Adopt(std::move(floor), std::move(wall));
+    return local;
+}
+
+// ---------- Cooked model cache ----------
+// <obj>.cook sits next to the OBJ and holds everything LoadModelData needs, laid out so the
+// arrays can be used straight out of the mapping:
+//   CookHeader | CookMesh[] | CookTexture[] | strings | vertices | indices | chunks | floor tris | wall tris
+// Offsets are from the start of the file and 16-byte aligned; the checksum covers everything
+// after the header. A cook is used only if it is at least as new as the OBJ.
+const char     COOK_MAGIC[4] = { 'C', 'K', 'M', 'D' };
+const uint32_t COOK_VERSION = 3;  // 2: draw chunks, 3: cache/overdraw/fetch-optimized buffers
+const uint32_t COOK_HAS_COLLISION = 1u << 0;
+
+struct CookHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t meshCount, textureCount;
+    uint32_t floorCount, wallCount;
+    uint32_t chunkCount;
+    uint64_t fileBytes;
+    uint64_t checksum;
+    uint64_t meshOffset, textureOffset, stringOffset, vertexOffset, indexOffset, floorOffset, wallOffset, chunkOffset;
+};
+struct CookMesh { uint64_t firstVertex, vertexCount, firstIndex, indexCount; uint32_t firstTexture, textureCount, firstChunk, chunkCount; };
+struct CookTexture { uint32_t typeOffset, typeLen, pathOffset, pathLen; };
+static_assert(sizeof(Tri) == 48 && sizeof(PackedVertex) == 32 && sizeof(MeshChunk) == 32, "cooked layout assumes tightly packed glm vectors");
+
+// FNV-1a over 64-bit words (plus the byte tail)
+uint64_t CookChecksum(const uint8_t* p, size_t n) {
+    uint64_t h = 1469598103934665603ull;
+    size_t words = n / 8;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t w; std::memcpy(&w, p + i * 8, 8);
+        h = (h ^ w) * 1099511628211ull;
+    }
+    for (size_t i = words * 8; i < n; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+static inline uint64_t AlignUp16(uint64_t v) { return (v + 15) & ~uint64_t(15); }
+
+bool WriteCookedModel(const ModelData& m, const std::string& cookPath) {
+    uint64_t vertexCount = 0, indexCount = 0;
+    uint32_t chunkCount = 0;
+    std::vector<CookMesh> meshes;
+    std::vector<CookTexture> textures;
+    std::string strings;
+    for (const auto& md : m.meshes) {
+        CookMesh cm{ vertexCount, md.vertices.size(), indexCount, md.indices.size(), (uint32_t)textures.size(), (uint32_t)md.textures.size(),
+                     chunkCount, (uint32_t)md.chunks.size() };
+        for (const auto& t : md.textures) {
+            CookTexture ct{ (uint32_t)strings.size(), (uint32_t)t.type.size(), 0, (uint32_t)t.path.size() };
+            strings += t.type;
+            ct.pathOffset = (uint32_t)strings.size();
+            strings += t.path;
+            textures.push_back(ct);
+        }
+        vertexCount += md.vertices.size();
+        indexCount += md.indices.size();
+        chunkCount += (uint32_t)md.chunks.size();
+        meshes.push_back(cm);
+    }
+    bool withCollision = !m.collision.Empty();
+
+    CookHeader h{};
+    std::memcpy(h.magic, COOK_MAGIC, 4);
+    h.version = COOK_VERSION;
+    h.flags = withCollision ? COOK_HAS_COLLISION : 0u;
+    h.meshCount = (uint32_t)meshes.size();
+    h.textureCount = (uint32_t)textures.size();
+    h.floorCount = (uint32_t)m.collision.floorTris.size();
+    h.wallCount = (uint32_t)m.collision.wallTris.size();
+    h.chunkCount = chunkCount;
+    h.meshOffset = AlignUp16(sizeof(CookHeader));
+    h.textureOffset = AlignUp16(h.meshOffset + meshes.size() * sizeof(CookMesh));
+    h.stringOffset = AlignUp16(h.textureOffset + textures.size() * sizeof(CookTexture));
+    h.vertexOffset = AlignUp16(h.stringOffset + strings.size());
+    h.indexOffset = AlignUp16(h.vertexOffset + vertexCount * sizeof(PackedVertex));
+    h.chunkOffset = AlignUp16(h.indexOffset + indexCount * sizeof(uint32_t));
+    h.floorOffset = AlignUp16(h.chunkOffset + chunkCount * sizeof(MeshChunk));
+    h.wallOffset = AlignUp16(h.floorOffset + h.floorCount * sizeof(Tri));
+    h.fileBytes = AlignUp16(h.wallOffset + h.wallCount * sizeof(Tri));
+
+    std::vector<uint8_t> buf(h.fileBytes, 0);
+    auto put = [&](uint64_t off, const void* src, size_t bytes) { if (bytes) std::memcpy(buf.data() + off, src, bytes); };
+    put(h.meshOffset, meshes.data(), meshes.size() * sizeof(CookMesh));
+    put(h.textureOffset, textures.data(), textures.size() * sizeof(CookTexture));
+    put(h.stringOffset, strings.data(), strings.size());
+    uint64_t vo = h.vertexOffset, io = h.indexOffset, co = h.chunkOffset;
+    for (const auto& md : m.meshes) {
+        put(vo, md.vertices.data, md.vertices.size() * sizeof(PackedVertex)); vo += md.vertices.size() * sizeof(PackedVertex);
+        put(io, md.indices.data, md.indices.size() * sizeof(uint32_t));       io += md.indices.size() * sizeof(uint32_t);
+        put(co, md.chunks.data, md.chunks.size() * sizeof(MeshChunk));        co += md.chunks.size() * sizeof(MeshChunk);
+    }
+    put(h.floorOffset, m.collision.floorTris.data, h.floorCount * sizeof(Tri));
+    put(h.wallOffset, m.collision.wallTris.data, h.wallCount * sizeof(Tri));
+    h.checksum = CookChecksum(buf.data() + sizeof(CookHeader), buf.size() - sizeof(CookHeader));
+    std::memcpy(buf.data(), &h, sizeof(h));
+
+    // write to a temp file and rename so a crash never leaves a truncated cook behind
+    std::string tmp = cookPath + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if (!f.write((const char*)buf.data(), (std::streamsize)buf.size())) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, cookPath, ec);
+    if (ec) { std::filesystem::remove(tmp, ec); return false; }
+    return true;
+}
+
+bool LoadCookedModel(const std::string& objPath, const std::string& cookPath, bool withCollision, ModelData& out) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->Open(cookPath) || file->size < sizeof(CookHeader)) return false;
+
+    CookHeader h;
+    std::memcpy(&h, file->data, sizeof(h));
+    if (std::memcmp(h.magic, COOK_MAGIC, 4) != 0 || h.version != COOK_VERSION || h.fileBytes != file->size) return false;
+    if (withCollision && !(h.flags & COOK_HAS_COLLISION)) return false;
+    auto reject = [&](const char* why) {
+        std::cout << "[Cook] " << why << " in " << cookPath << "\n";
+        return false;
+    };
+
+    // Sections are 16-byte aligned and laid out in writer order; the string table, vertices and
+    // indices have no counts of their own and run up to the next section.
+    const uint64_t sections[] = { h.meshOffset, h.textureOffset, h.stringOffset, h.vertexOffset, h.indexOffset,
+                                  h.chunkOffset, h.floorOffset, h.wallOffset, h.fileBytes };
+    if (sections[0] < sizeof(CookHeader)) return reject("bad section layout");
+    for (size_t i = 0; i + 1 < sizeof(sections) / sizeof(sections[0]); ++i)
+        if (sections[i] % 16 != 0 || sections[i] > sections[i + 1]) return reject("bad section layout");
+    auto fits = [](uint64_t off, uint64_t count, uint64_t size, uint64_t end) {
+        return count <= (end - off) / size;
+    };
+    if (!fits(h.meshOffset, h.meshCount, sizeof(CookMesh), h.textureOffset) ||
+        !fits(h.textureOffset, h.textureCount, sizeof(CookTexture), h.stringOffset) ||
+        !fits(h.chunkOffset, h.chunkCount, sizeof(MeshChunk), h.floorOffset) ||
+        !fits(h.floorOffset, h.floorCount, sizeof(Tri), h.wallOffset) ||
+        !fits(h.wallOffset, h.wallCount, sizeof(Tri), h.fileBytes)) return reject("section overflow");
+    const uint64_t stringBytes = h.vertexOffset - h.stringOffset;
+    const uint64_t vertexTotal = (h.indexOffset - h.vertexOffset) / sizeof(PackedVertex);
+    const uint64_t indexTotal = (h.chunkOffset - h.indexOffset) / sizeof(uint32_t);
+    if (CookChecksum(file->data + sizeof(CookHeader), file->size - sizeof(CookHeader)) != h.checksum) {
+        std::cout << "[Cook] checksum mismatch in " << cookPath << "\n";
+        return false;
+    }
+
+    const CookMesh* meshes = (const CookMesh*)(file->data + h.meshOffset);
+    const CookTexture* textures = (const CookTexture*)(file->data + h.textureOffset);
+    const char* strings = (const char*)(file->data + h.stringOffset);
+    const PackedVertex* vertices = (const PackedVertex*)(file->data + h.vertexOffset);
+    const uint32_t* indices = (const uint32_t*)(file->data + h.indexOffset);
+    const MeshChunk* chunks = (const MeshChunk*)(file->data + h.chunkOffset);
+
+    out = ModelData();
+    out.source = objPath;
+    out.directory = objPath.substr(0, objPath.find_last_of('/'));
+    auto inRange = [](uint64_t first, uint64_t count, uint64_t total) { return first <= total && count <= total - first; };
+    for (uint32_t i = 0; i < h.meshCount; ++i) {
+        const CookMesh& cm = meshes[i];
+        if (!inRange(cm.firstVertex, cm.vertexCount, vertexTotal) ||
+            !inRange(cm.firstIndex, cm.indexCount, indexTotal) ||
+            !inRange(cm.firstTexture, cm.textureCount, h.textureCount) ||
+            !inRange(cm.firstChunk, cm.chunkCount, h.chunkCount)) return reject("mesh range out of bounds");
+        MeshData md;
+        md.vertices = { vertices + cm.firstVertex, (size_t)cm.vertexCount };
+        md.indices = { indices + cm.firstIndex, (size_t)cm.indexCount };
+        md.chunks = { chunks + cm.firstChunk, (size_t)cm.chunkCount };
+        for (const MeshChunk& c : md.chunks)
+            if (!inRange(c.firstIndex, c.indexCount, cm.indexCount)) return reject("chunk range out of bounds");
+        for (uint32_t idx : md.indices)
+            if (idx >= cm.vertexCount) return reject("vertex index out of range");
+        for (uint32_t t = 0; t < cm.textureCount; ++t) {
+            const CookTexture& ct = textures[cm.firstTexture + t];
+            if (!inRange(ct.typeOffset, ct.typeLen, stringBytes) || !inRange(ct.pathOffset, ct.pathLen, stringBytes))
+                return reject("texture name out of bounds");
+            md.textures.push_back({ std::string(strings + ct.typeOffset, ct.typeLen), std::string(strings + ct.pathOffset, ct.pathLen) });
+        }
+        out.meshes.push_back(std::move(md));
+    }
+    if (h.flags & COOK_HAS_COLLISION) {
+        out.collision.floorTris = { (const Tri*)(file->data + h.floorOffset), h.floorCount };
+        out.collision.wallTris = { (const Tri*)(file->data + h.wallOffset), h.wallCount };
+        out.collision.backing = file;
+    }
+    out.mapping = file;
+    out.cooked = true;
+    return true;
+}
+
+// Load from the cook when it is current, otherwise import the OBJ and (re)write the cook.
+bool LoadModelData(const std::string& objPath, bool withCollision, ModelData& out) {
+    auto t0 = std::chrono::steady_clock::now();
+    auto ms = [&]() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+    std::string cookPath = objPath + ".cook";
+    std::string name = objPath.substr(objPath.find_last_of('/') + 1);
+
+    std::error_code e1, e2;
+    auto objTime = std::filesystem::last_write_time(objPath, e1);
+    auto cookTime = std::filesystem::last_write_time(cookPath, e2);
+    if (!e2 && (e1 || cookTime >= objTime) && LoadCookedModel(objPath, cookPath, withCollision, out)) {
+        std::cout << "[Load] " << name << ": cooked " << ms() << " ms (" << out.mapping->size / 1024 << " KB mapped)\n";
+        return true;
+    }
+
+    out = ModelData();
+    if (!ImportModelObj(objPath, out)) return false;
+    double importMs = ms();
+    if (withCollision) out.collision = ClassifyMapLocal(out);
+    bool wrote = WriteCookedModel(out, cookPath);
+    std::cout << "[Load] " << name << ": imported " << importMs << " ms, total " << ms() << " ms"
+        << (wrote ? " (cook written)" : " (cook write failed)") << "\n";
+    return true;
+}
+
+#endif
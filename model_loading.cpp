@@ -5,10 +5,19 @@
 //   Shift  : sprint
 //   Space  : jump
 //   LMB    : shoot
-//   U / J  : raise / lower map (rebuilds collider)
+//   U / J  : raise / lower map (shifts collider in place)
+//   [ / ]  : rotate map yaw,  - / = : scale map (collider rebuilds in the background)
 //   PgUp/Dn: PLAYER_FOOT_BIAS,  Home/End: ENEMY_FOOT_BIAS
 //   F1     : toggle wireframe
+//   F2     : toggle heightfield floor lookups
+//   F3     : triangle kernel microbenchmark (console)
+//   F4     : toggle profiler summary in the title bar
+//   F5     : start / stop a profile capture (profile_N.csv + profile_N.json Chrome trace)
+//   F6     : toggle software occlusion culling
 //   ESC    : quit
+// Command line: --record <file> / --replay <file> (per-tick input, see InputRecorder)
+//               --crowd <N> (patrolling enemies, default 1; a replay restores its own count)
+//               --threads <N> (threads for loading and the simulation, main thread included; 1 = no workers)
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -26,7 +35,14 @@
 #include <algorithm>
 #include <string>
 #include <cmath>
-#include <limits>
+#include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <map>
+#include <optional>
+
+#include "simulation.h"
+#include "occlusion.h"
 
 // ---------- Map path ----------
 static const char* MAP_MODEL_RELATIVE_PATH =
@@ -49,185 +65,687 @@ float  lastY = SCR_HEIGHT * 0.5f;
 float gCamYawDeg = 0.0f;
 float gCamPitchDeg = -15.0f;
 
-float gPlayerYawDeg = 0.0f;
 float gCamDistance = 5.2f;
 float gCamHeight = 2.4f;
 float gCamSmooth = 0.18f;
 
-// ---------- Movement ----------
-float gWalkSpeed = 10.5f;
-float gSprintMul = 1.6f;
-
-// ---------- Vertical physics (jump) ----------
-float gVelY = 0.0f;
-bool  gGrounded = false;
-const float GRAVITY = 25.0f;
-const float JUMP_FORCE = 9.5f;
-
-// ---------- Step-up / step-down helpers ----------
-const float STEP_MAX = 1.25f; // max height we can step up
-const float STEP_SNAP_EPS = 0.03f;
-const float STEP_DOWN_MAX = 1.35f;
-
-// Unstick from corners
-const float SKIN = 0.04f;
-const int   UNSTICK_ITER = 4;
-
 // ---------- Shooting ----------
 bool  gShootHeld = false;
-float gShootCooldown = 0.0f;
 
 // ---------- Debug ----------
 bool gWire = false;
+bool   gProfileTitle = true;     // rolling profiler summary in the title bar
+double gTitleHoldUntil = 0.0;    // keeps a tuning title visible for a moment before the summary returns
+int    gCaptureIndex = 0;
+
+// ---------- GL state cache ----------
+// Skips glUseProgram / glBindTexture calls that would not change anything. Uploads bind
+// textures behind its back, so Reset() runs at the start of each frame's rendering.
+// Each material texture type has a fixed unit; only the first texture of a type is bound,
+// which is all the LearnOpenGL shaders sample (texture_diffuse1 etc.).
+const int MATERIAL_SLOTS = 4;
+static const char* const MATERIAL_TYPES[MATERIAL_SLOTS] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+static const char* const MATERIAL_SAMPLERS[MATERIAL_SLOTS] = { "texture_diffuse1", "texture_specular1", "texture_normal1", "texture_height1" };
+
+struct GLStateCache {
+    int programBinds = 0, textureBinds = 0;  // since Reset, for the profiler
+
+    void Reset() {
+        program = ~0u;
+        for (GLuint& t : textures) t = ~0u;
+        programBinds = textureBinds = 0;
+    }
+    void UseProgram(GLuint id) {
+        if (id == program) return;
+        glUseProgram(id);
+        program = id;
+        ++programBinds;
+    }
+    void BindTexture(int slot, GLuint id) {
+        if (textures[slot] == id) return;
+        glActiveTexture(GL_TEXTURE0 + slot);
+        glBindTexture(GL_TEXTURE_2D, id);
+        textures[slot] = id;
+        ++textureBinds;
+    }
 
-// ---------- Bullets ----------
-struct Bullet {
-    glm::vec3 pos{ 0 };
-    glm::vec3 vel{ 0 };
-    float life{ 4.0f };
-    float radius{ 0.2f };
-    bool  active{ true };
+private:
+    GLuint program = ~0u;
+    GLuint textures[MATERIAL_SLOTS] = { ~0u, ~0u, ~0u, ~0u };
 };
-std::vector<Bullet> gBullets;
-
-// ---------- 2D AABB (XZ) ----------
-struct AABB2D { glm::vec2 center, halfExt; };
-static inline bool IntersectsXZ(const AABB2D& a, const AABB2D& b) {
-    if (std::abs(a.center.x - b.center.x) > (a.halfExt.x + b.halfExt.x)) return false;
-    if (std::abs(a.center.y - b.center.y) > (a.halfExt.y + b.halfExt.y)) return false;
-    return true;
-}
-static inline void ResolveStaticXZ(const AABB2D& statBox, AABB2D& dynBox, glm::vec3& posXZ) {
-    float dx = dynBox.center.x - statBox.center.x;
-    float dz = dynBox.center.y - statBox.center.y;
-    float px = (dynBox.halfExt.x + statBox.halfExt.x) - std::abs(dx);
-    float pz = (dynBox.halfExt.y + statBox.halfExt.y) - std::abs(dz);
-    if (px < 0 || pz < 0) return;
-    if (px < pz) { float sx = (dx < 0 ? -1.f : 1.f); posXZ.x += sx * px; dynBox.center.x += sx * px; }
-    else { float sz = (dz < 0 ? -1.f : 1.f); posXZ.z += sz * pz; dynBox.center.y += sz * pz; }
+GLStateCache gGL;
+
+void BindMaterialTextures(const std::vector<Texture>& textures) {
+    bool bound[MATERIAL_SLOTS] = {};
+    for (const Texture& t : textures)
+        for (int s = 0; s < MATERIAL_SLOTS; ++s)
+            if (!bound[s] && t.type == MATERIAL_TYPES[s]) { gGL.BindTexture(s, t.id); bound[s] = true; break; }
 }
 
-// ---------- Map placement ----------
-float MAP_Y_OFFSET = -20.0f;
-float MAP_SCALE = 1.0f;
-float MAP_YAW_DEG = 0.0f;
+// ---------- Shader bindings ----------
+// Uniform locations looked up once after linking. Camera matrices are not per-program
+// uniforms: every program reads the std140 Camera block, filled once per frame.
+const GLuint CAMERA_UBO_BINDING = 0;
+
+struct CameraBlock { glm::mat4 projection, view, viewProjection; };  // std140: three column-major mat4s, no padding
+static_assert(sizeof(CameraBlock) == 192, "Camera block must match the std140 layout in the shaders");
+
+struct ShaderBinding {
+    GLuint program = 0;
+    GLint  model = -1;
+
+    explicit ShaderBinding(const Shader& shader) : program(shader.ID) {
+        model = glGetUniformLocation(program, "model");
+        GLuint block = glGetUniformBlockIndex(program, "Camera");
+        if (block != GL_INVALID_INDEX) glUniformBlockBinding(program, block, CAMERA_UBO_BINDING);
+        glUseProgram(program);
+        for (int s = 0; s < MATERIAL_SLOTS; ++s) {
+            GLint loc = glGetUniformLocation(program, MATERIAL_SAMPLERS[s]);
+            if (loc >= 0) glUniform1i(loc, s);
+        }
+        glUseProgram(0);
+    }
+
+    void Use() const { gGL.UseProgram(program); }
+    void SetModel(const glm::mat4& M) const { if (model >= 0) glUniformMatrix4fv(model, 1, GL_FALSE, glm::value_ptr(M)); }
+};
 
-float PLAYER_FOOT_BIAS = 1.15f;
-float ENEMY_FOOT_BIAS = 1.15f;
+struct CameraUniforms {
+    void Init() {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UBO_BINDING, ubo);
+    }
+    void Update(const glm::mat4& P, const glm::mat4& V) {
+        CameraBlock block{ P, V, P * V };
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
 
-// ---------- Map collision data ----------
-struct Tri { glm::vec3 a, b, c; glm::vec3 n; };
+private:
+    GLuint ubo = 0;
+};
 
-// Height-aware wall box
-struct WallBox {
-    AABB2D boxXZ;
-    float  minY, maxY;
+// ---------- GPU models ----------
+struct GpuMesh {
+    GLuint  VAO = 0, VBO = 0, EBO = 0;
+    GLsizei indexCount = 0;
+    std::vector<Texture> textures;
+
+    // The caller has the program bound (see ShaderBinding / DrawQueue).
+    void Draw() const {
+        BindMaterialTextures(textures);
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    }
+
+    // Needs a VAO with per-instance attributes, see InstanceBatch.
+    void DrawInstanced(GLsizei instances) const {
+        BindMaterialTextures(textures);
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instances);
+    }
 };
 
-std::vector<Tri>     gFloorTris;
-std::vector<WallBox> gWalls;
+// PackedVertex attributes 0..2 on the bound VAO / GL_ARRAY_BUFFER
+void SetupVertexLayout() {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+}
+
+// ---------- Frustum culling ----------
+// Planes pulled from projection * view (Gribb/Hartmann); a box is outside when its corner
+// furthest along a plane's normal is still behind that plane.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& PV) {
+        glm::vec4 r0(PV[0][0], PV[1][0], PV[2][0], PV[3][0]);
+        glm::vec4 r1(PV[0][1], PV[1][1], PV[2][1], PV[3][1]);
+        glm::vec4 r2(PV[0][2], PV[1][2], PV[2][2], PV[3][2]);
+        glm::vec4 r3(PV[0][3], PV[1][3], PV[2][3], PV[3][3]);
+        planes[0] = r3 + r0; planes[1] = r3 - r0;
+        planes[2] = r3 + r1; planes[3] = r3 - r1;
+        planes[4] = r3 + r2; planes[5] = r3 - r2;
+    }
 
-const float FLOOR_MIN_NY = 0.55f; // treat tri as floor if normal.y >= this
-const float WALL_MAX_NY = 0.25f; // treat tri as wall if |normal.y| <= this
+    bool Intersects(const glm::vec3& bmin, const glm::vec3& bmax) const {
+        for (const glm::vec4& p : planes) {
+            glm::vec3 v(p.x >= 0.0f ? bmax.x : bmin.x, p.y >= 0.0f ? bmax.y : bmin.y, p.z >= 0.0f ? bmax.z : bmin.z);
+            if (p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0.0f) return false;
+        }
+        return true;
+    }
+};
 
-glm::mat4 MapTransform() {
-    glm::mat4 M(1.0f);
-    M = glm::translate(M, glm::vec3(0.f, MAP_Y_OFFSET, 0.f));
-    M = glm::rotate(M, glm::radians(MAP_YAW_DEG), glm::vec3(0, 1, 0));
-    M = glm::scale(M, glm::vec3(MAP_SCALE));
-    return M;
+// ---------- Static batches ----------
+// Static geometry (the map) in one VAO: all vertices in one buffer and all indices, rebased
+// onto it, in one index buffer ordered by texture set. Each texture set is a group drawn
+// with one multi-draw of its chunks that touch the frustum, neighbouring visible chunks
+// merged. With GL 4.3 / ARB_multi_draw_indirect the draws come from a streamed indirect
+// buffer (glad is generated for 3.3, so the entry point is fetched with glfwGetProcAddress);
+// otherwise glMultiDrawElements, which core 3.3 has.
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+struct DrawElementsIndirectCommand { GLuint count, instanceCount, firstIndex, baseVertex, baseInstance; };
+using MultiDrawElementsIndirectFn = void (APIENTRY*)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+MultiDrawElementsIndirectFn gMultiDrawElementsIndirect = nullptr;
+
+void LoadMultiDrawIndirect(GLFWwindow* window) {
+    int major = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MAJOR);
+    int minor = glfwGetWindowAttrib(window, GLFW_CONTEXT_VERSION_MINOR);
+    if (major > 4 || (major == 4 && minor >= 3) || glfwExtensionSupported("GL_ARB_multi_draw_indirect"))
+        gMultiDrawElementsIndirect = (MultiDrawElementsIndirectFn)glfwGetProcAddress("glMultiDrawElementsIndirect");
+    std::cout << "[Batch] GL " << major << "." << minor << ", static geometry via "
+        << (gMultiDrawElementsIndirect ? "glMultiDrawElementsIndirect" : "glMultiDrawElements") << "\n";
 }
 
-void BuildMapCollision(const Model& mapModel) {
-    gFloorTris.clear();
-    gWalls.clear();
-
-    glm::mat4 T = MapTransform();
-    for (const auto& mesh : mapModel.meshes) {
-        const auto& V = mesh.vertices;
-        const auto& I = mesh.indices;
-        if (I.empty() || V.empty()) continue;
-
-        for (size_t i = 0; i + 2 < I.size(); i += 3) {
-            glm::vec3 a = glm::vec3(T * glm::vec4(V[I[i + 0]].Position, 1.0));
-            glm::vec3 b = glm::vec3(T * glm::vec4(V[I[i + 1]].Position, 1.0));
-            glm::vec3 c = glm::vec3(T * glm::vec4(V[I[i + 2]].Position, 1.0));
-            glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
-            float ny = std::abs(n.y);
-
-            if (n.y >= FLOOR_MIN_NY) {
-                gFloorTris.push_back({ a,b,c,n });
+struct StaticBatch {
+    int drawn = 0, culled = 0, occluded = 0, draws = 0;  // chunks and multi-draw calls in the last Draw
+
+    bool Empty() const { return groups.empty(); }
+
+    // meshTextures[i] are the resolved textures of data.meshes[i]
+    void Build(const ModelData& data, const std::vector<std::vector<Texture>>& meshTextures) {
+        std::map<std::string, int> groupOf;
+        std::vector<std::vector<int>> members;
+        for (int mi = 0; mi < (int)data.meshes.size(); ++mi) {
+            std::string key;
+            for (const Texture& t : meshTextures[mi]) key += t.type + ':' + std::to_string(t.id) + ';';
+            auto [it, added] = groupOf.emplace(key, (int)groups.size());
+            if (added) { groups.push_back({ meshTextures[mi] }); members.emplace_back(); }
+            members[it->second].push_back(mi);
+        }
+
+        std::vector<uint32_t> baseVertex(data.meshes.size());
+        size_t vertexCount = 0, indexCount = 0;
+        for (size_t mi = 0; mi < data.meshes.size(); ++mi) {
+            baseVertex[mi] = (uint32_t)vertexCount;
+            vertexCount += data.meshes[mi].vertices.size();
+            indexCount += data.meshes[mi].indices.size();
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), nullptr, GL_STATIC_DRAW);
+        for (size_t mi = 0; mi < data.meshes.size(); ++mi) {
+            const auto& V = data.meshes[mi].vertices;
+            glBufferSubData(GL_ARRAY_BUFFER, baseVertex[mi] * sizeof(PackedVertex), V.size() * sizeof(PackedVertex), V.data);
+        }
+
+        std::vector<uint32_t> indices;
+        indices.reserve(indexCount);
+        for (size_t g = 0; g < groups.size(); ++g) {
+            groups[g].firstItem = (int)items.size();
+            for (int mi : members[g]) {
+                const MeshData& md = data.meshes[mi];
+                uint32_t first = (uint32_t)indices.size();
+                for (uint32_t i : md.indices) indices.push_back(i + baseVertex[mi]);
+                if (md.chunks.empty()) {  // hand-built mesh: one chunk over the whole mesh
+                    Item whole{ first, (uint32_t)md.indices.size(), glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+                    for (uint32_t i : md.indices) { whole.bmin = glm::min(whole.bmin, md.vertices[i].Position); whole.bmax = glm::max(whole.bmax, md.vertices[i].Position); }
+                    if (whole.indexCount) items.push_back(whole);
+                }
+                for (const MeshChunk& c : md.chunks) items.push_back({ first + c.firstIndex, c.indexCount, c.bmin, c.bmax });
             }
-            else if (ny <= WALL_MAX_NY) {
-                // Build a height-aware wall box
-                float minx = std::min({ a.x,b.x,c.x });
-                float maxx = std::max({ a.x,b.x,c.x });
-                float minz = std::min({ a.z,b.z,c.z });
-                float maxz = std::max({ a.z,b.z,c.z });
-                float miny = std::min({ a.y,b.y,c.y });
-                float maxy = std::max({ a.y,b.y,c.y });
-                const float m = 0.06f;
-                minx -= m; maxx += m; minz -= m; maxz += m;
-
-                WallBox w;
-                w.boxXZ = { {(minx + maxx) * 0.5f,(minz + maxz) * 0.5f},
-                            {(maxx - minx) * 0.5f,(maxz - minz) * 0.5f} };
-                w.minY = miny;
-                w.maxY = maxy;
-                gWalls.push_back(w);
+            groups[g].itemCount = (int)items.size() - groups[g].firstItem;
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        SetupVertexLayout();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (gMultiDrawElementsIndirect) glGenBuffers(1, &commandBuffer);
+
+        std::cout << "[Batch] " << data.meshes.size() << " meshes -> " << groups.size() << " texture groups, "
+            << items.size() << " chunks, " << indexCount / 3 << " tris\n";
+    }
+
+    // The caller has the program bound and its model matrix set to M. Chunks inside the
+    // frustum are also tested against 'occlusion' when given.
+    void Draw(const glm::mat4& M, const Frustum& frustum, OcclusionBuffer* occlusion = nullptr) {
+        drawn = culled = occluded = draws = 0;
+        if (groups.empty()) return;
+        if (!boundsValid || !(transform == M)) UpdateBounds(M);
+
+        commands.clear();
+        for (Group& g : groups) {
+            g.firstCommand = (int)commands.size();
+            for (int i = g.firstItem; i < g.firstItem + g.itemCount; ++i) {
+                const Item& it = items[i];
+                if (!frustum.Intersects(worldMin[i], worldMax[i])) { ++culled; continue; }
+                if (occlusion && occlusion->Occluded(worldMin[i], worldMax[i])) { ++occluded; continue; }
+                ++drawn;
+                DrawElementsIndirectCommand* last = (int)commands.size() > g.firstCommand ? &commands.back() : nullptr;
+                if (last && last->firstIndex + last->count == it.firstIndex) last->count += it.indexCount;
+                else commands.push_back({ it.indexCount, 1, it.firstIndex, 0, 0 });
             }
+            g.commandCount = (int)commands.size() - g.firstCommand;
+        }
+        if (commands.empty()) return;
+
+        glBindVertexArray(VAO);
+        if (gMultiDrawElementsIndirect) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            commandCapacity = std::max(commandCapacity, commands.size());
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);  // orphan
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        }
+        else {
+            counts.resize(commands.size());
+            offsets.resize(commands.size());
+            for (size_t c = 0; c < commands.size(); ++c) {
+                counts[c] = (GLsizei)commands[c].count;
+                offsets[c] = (const void*)(sizeof(uint32_t) * commands[c].firstIndex);
+            }
+        }
+        for (const Group& g : groups) {
+            if (!g.commandCount) continue;
+            BindMaterialTextures(g.textures);
+            if (gMultiDrawElementsIndirect)
+                gMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(g.firstCommand * sizeof(DrawElementsIndirectCommand)), g.commandCount, 0);
+            else
+                glMultiDrawElements(GL_TRIANGLES, counts.data() + g.firstCommand, GL_UNSIGNED_INT, offsets.data() + g.firstCommand, g.commandCount);
+            ++draws;
         }
+        if (gMultiDrawElementsIndirect) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
     }
-    std::cout << "[MapCollider] floors=" << gFloorTris.size()
-        << " walls=" << gWalls.size() << "\n";
+
+private:
+    struct Item {
+        uint32_t  firstIndex, indexCount;  // into the shared index buffer
+        glm::vec3 bmin, bmax;              // model space
+    };
+    struct Group {
+        std::vector<Texture> textures;
+        int firstItem = 0, itemCount = 0;
+        int firstCommand = 0, commandCount = 0;  // this frame's visible runs
+    };
+
+    // World-space boxes, redone only when the map transform changes
+    void UpdateBounds(const glm::mat4& M) {
+        glm::mat3 absM(glm::abs(glm::vec3(M[0])), glm::abs(glm::vec3(M[1])), glm::abs(glm::vec3(M[2])));
+        worldMin.resize(items.size());
+        worldMax.resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            glm::vec3 center = glm::vec3(M * glm::vec4((items[i].bmin + items[i].bmax) * 0.5f, 1.0f));
+            glm::vec3 extent = absM * ((items[i].bmax - items[i].bmin) * 0.5f);
+            worldMin[i] = center - extent;
+            worldMax[i] = center + extent;
+        }
+        transform = M;
+        boundsValid = true;
+    }
+
+    GLuint VAO = 0, VBO = 0, EBO = 0, commandBuffer = 0;
+    std::vector<Group> groups;
+    std::vector<Item>  items;
+    std::vector<glm::vec3> worldMin, worldMax;
+    glm::mat4 transform{ 1.0f };
+    bool      boundsValid = false;
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    size_t                   commandCapacity = 0;
+    std::vector<GLsizei>     counts;   // glMultiDrawElements path
+    std::vector<const void*> offsets;
+};
+
+struct GpuModel {
+    std::vector<GpuMesh> meshes;
+    StaticBatch batch;  // used instead of meshes for static geometry, see UploadStaticModel
+    glm::vec3 bmin{ 0.0f }, bmax{ 0.0f };  // model-space bounds of 'meshes'
+};
+
+// Textures shared across all models, keyed by full path
+std::vector<Texture> gTexturesLoaded;
+
+std::vector<Texture> ResolveTextures(const MeshData& md, const std::string& directory) {
+    std::vector<Texture> out;
+    for (const auto& ref : md.textures) {
+        std::string full = directory + '/' + ref.path;
+        auto it = std::find_if(gTexturesLoaded.begin(), gTexturesLoaded.end(), [&](const Texture& t) { return t.path == full; });
+        if (it != gTexturesLoaded.end()) { Texture t = *it; t.type = ref.type; out.push_back(t); continue; }
+        Texture t;
+        t.id = TextureFromFile(ref.path.c_str(), directory);
+        t.type = ref.type;
+        t.path = full;
+        gTexturesLoaded.push_back(t);
+        out.push_back(t);
+    }
+    return out;
+}
+
+// Vertex and index data go to GL straight from the views, i.e. from the file mapping when cooked.
+GpuModel UploadModel(const ModelData& data) {
+    GpuModel model;
+    model.bmin = glm::vec3(std::numeric_limits<float>::max());
+    model.bmax = glm::vec3(-std::numeric_limits<float>::max());
+    for (const auto& md : data.meshes) {
+        for (const PackedVertex& v : md.vertices) { model.bmin = glm::min(model.bmin, v.Position); model.bmax = glm::max(model.bmax, v.Position); }
+        GpuMesh gm;
+        gm.indexCount = (GLsizei)md.indices.size();
+        glGenVertexArrays(1, &gm.VAO);
+        glGenBuffers(1, &gm.VBO);
+        glGenBuffers(1, &gm.EBO);
+        glBindVertexArray(gm.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, gm.VBO);
+        glBufferData(GL_ARRAY_BUFFER, md.vertices.size() * sizeof(PackedVertex), md.vertices.data, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gm.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, md.indices.size() * sizeof(uint32_t), md.indices.data, GL_STATIC_DRAW);
+        SetupVertexLayout();
+        glBindVertexArray(0);
+
+        gm.textures = ResolveTextures(md, data.directory);
+        model.meshes.push_back(std::move(gm));
+    }
+    return model;
 }
 
-// Möller–Trumbore
-bool RaycastTri(const glm::vec3& ro, const glm::vec3& rd, const Tri& tri, float& tHit) {
-    const float EPS = 1e-6f;
-    glm::vec3 v0v1 = tri.b - tri.a;
-    glm::vec3 v0v2 = tri.c - tri.a;
-    glm::vec3 pvec = glm::cross(rd, v0v2);
-    float det = glm::dot(v0v1, pvec);
-    if (fabs(det) < EPS) return false;
-    float invDet = 1.0f / det;
-
-    glm::vec3 tvec = ro - tri.a;
-    float u = glm::dot(tvec, pvec) * invDet; if (u < 0.0f || u > 1.0f) return false;
-    glm::vec3 qvec = glm::cross(tvec, v0v1);
-    float v = glm::dot(rd, qvec) * invDet;   if (v < 0.0f || (u + v) > 1.0f) return false;
-
-    float t = glm::dot(v0v2, qvec) * invDet; if (t <= 0.0f) return false;
-    tHit = t; return true;
+// Static geometry goes into one StaticBatch instead of a VAO per mesh.
+GpuModel UploadStaticModel(const ModelData& data) {
+    std::vector<std::vector<Texture>> textures;
+    for (const auto& md : data.meshes) textures.push_back(ResolveTextures(md, data.directory));
+    GpuModel model;
+    model.batch.Build(data, textures);
+    return model;
 }
 
-float SampleFloorY(const glm::vec3& worldPosXZ) {
-    glm::vec3 ro(worldPosXZ.x, 1000.0f, worldPosXZ.z);
-    glm::vec3 rd(0, -1, 0);
+// ---------- Instanced drawing ----------
+// Per-instance model matrices for one model, drawn with one glDrawElementsInstanced per mesh.
+// The matrices live in a single buffer that each mesh VAO reads at locations 3..6 with
+// divisor 1 (see 1.model_loading_instanced.vs). Upload orphans the store before writing
+// so the driver hands out fresh memory instead of waiting on last frame's draw.
+struct InstanceBatch {
+    std::vector<glm::mat4> transforms;  // refilled by the caller every frame
+
+    // The caller has the instanced program bound.
+    void Draw(const GpuModel& model) {
+        if (transforms.empty() || model.meshes.empty()) return;
+        if (attachedTo != &model || attachedMeshes != model.meshes.size()) Attach(model);
+        Upload();
+        for (const auto& m : model.meshes) m.DrawInstanced((GLsizei)transforms.size());
+        glBindVertexArray(0);
+    }
+
+private:
+    GLuint      VBO = 0;
+    size_t      capacity = 0;  // in matrices
+    const GpuModel* attachedTo = nullptr;
+    size_t      attachedMeshes = 0;
+
+    // Models may finish uploading after the batch is first used, so this runs lazily.
+    void Attach(const GpuModel& model) {
+        if (!VBO) glGenBuffers(1, &VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        for (const auto& m : model.meshes) {
+            glBindVertexArray(m.VAO);
+            for (int c = 0; c < 4; ++c) {
+                glEnableVertexAttribArray(3 + c);
+                glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * c));
+                glVertexAttribDivisor(3 + c, 1);
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        attachedTo = &model;
+        attachedMeshes = model.meshes.size();
+    }
+
+    void Upload() {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        capacity = std::max(capacity, transforms.size());
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);  // orphan
+        glBufferSubData(GL_ARRAY_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+// ---------- Draw queue ----------
+// Per-mesh draws collected over the frame and sorted by program, then diffuse texture, so
+// program and texture switches happen once per run of equal state instead of per mesh.
+struct DrawQueue {
+    int draws = 0;  // in the last Flush
+
+    void Add(const ShaderBinding& program, const GpuModel& model, const glm::mat4& M) {
+        for (const GpuMesh& mesh : model.meshes) {
+            GLuint tex = mesh.textures.empty() ? 0 : mesh.textures[0].id;
+            items.push_back({ ((uint64_t)program.program << 32) | tex, &program, &mesh, M });
+        }
+    }
+
+    void Flush() {
+        std::stable_sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+        for (const Item& it : items) {
+            it.program->Use();
+            it.program->SetModel(it.model);
+            it.mesh->Draw();
+        }
+        glBindVertexArray(0);
+        draws = (int)items.size();
+        items.clear();
+    }
 
-    float bestT = std::numeric_limits<float>::infinity();
-    bool  hit = false;
+private:
+    struct Item {
+        uint64_t             key;
+        const ShaderBinding* program;
+        const GpuMesh*       mesh;
+        glm::mat4            model;
+    };
+    std::vector<Item> items;
+};
 
-    for (const Tri& tri : gFloorTris) {
-        float t;
-        if (RaycastTri(ro, rd, tri, t)) {
-            if (t > 0.0f && t < bestT) { bestT = t; hit = true; }
+// ---------- GPU timers ----------
+// One GL_TIME_ELAPSED query per draw group per frame, double-buffered: a frame's queries
+// are read back just before their slot is reused two frames later, and only if the result
+// is already available, so timing never stalls the pipeline (a late sample is dropped).
+const int GPU_TIMER_FRAMES = 2;
+
+struct GpuTimers {
+    void Init() { glGenQueries(GPU_TIMER_FRAMES * GPU_GROUP_COUNT, &ids[0][0]); }
+
+    void BeginFrame() {
+        slot = (slot + 1) % GPU_TIMER_FRAMES;
+        for (int g = 0; g < GPU_GROUP_COUNT; ++g) {
+            if (!issued[slot][g]) continue;
+            issued[slot][g] = false;
+            GLint ready = 0;
+            glGetQueryObjectiv(ids[slot][g], GL_QUERY_RESULT_AVAILABLE, &ready);
+            if (!ready) continue;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(ids[slot][g], GL_QUERY_RESULT, &ns);
+            gProfiler.SetGpu((GpuGroup)g, ns * 1e-6);
         }
     }
-    if (hit) return ro.y + bestT * rd.y;
-    return MAP_Y_OFFSET;
+
+    // Groups must not nest: only one GL_TIME_ELAPSED query can be active at a time.
+    void Begin(GpuGroup g) { if (gProfiler.enabled) glBeginQuery(GL_TIME_ELAPSED, ids[slot][g]); }
+    void End(GpuGroup g) {
+        if (!gProfiler.enabled) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[slot][g] = true;
+    }
+
+private:
+    GLuint ids[GPU_TIMER_FRAMES][GPU_GROUP_COUNT] = {};
+    bool   issued[GPU_TIMER_FRAMES][GPU_GROUP_COUNT] = {};
+    int    slot = 0;
+};
+
+// ---------- Async asset loading ----------
+// Workers parse/map models and decode textures; the GL thread only uploads finished pieces.
+struct DecodedImage {
+    int width = 0, height = 0, channels = 0;
+    unsigned char* pixels = nullptr;
+};
+
+DecodedImage DecodeImage(const std::string& fullPath) {
+    DecodedImage img;
+    img.pixels = stbi_load(fullPath.c_str(), &img.width, &img.height, &img.channels, 0);
+    return img;
 }
 
-// Height-aware wall check
-inline bool IntersectsWallAtHeight(const WallBox& w, const AABB2D& ply, float footY) {
-    const float Y_PAD_DOWN = 0.6f;  // allow a bit of overlap below feet
-    const float Y_PAD_UP = 1.8f;  // wall height that can block (roughly up to chest/head)
-    if (footY < (w.minY - Y_PAD_DOWN) || footY >(w.maxY + Y_PAD_UP)) return false;
-    return IntersectsXZ(ply, w.boxXZ);
+// Same texture setup as LearnOpenGL's TextureFromFile; frees the decoded pixels.
+unsigned int UploadImage(DecodedImage& img, const std::string& fullPath) {
+    unsigned int id;
+    glGenTextures(1, &id);
+    if (!img.pixels) { std::cout << "Texture failed to load at path: " << fullPath << "\n"; return id; }
+
+    GLenum format = img.channels == 1 ? GL_RED : img.channels == 3 ? GL_RGB : GL_RGBA;
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, img.width, img.height, 0, format, GL_UNSIGNED_BYTE, img.pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    stbi_image_free(img.pixels);
+    img.pixels = nullptr;
+    return id;
 }
 
-void ResolveStaticWall(const WallBox& w, AABB2D& dynBox, glm::vec3& posXZ) {
-    ResolveStaticXZ(w.boxXZ, dynBox, posXZ);
+class AssetLoader {
+public:
+    // Queue a model; 'target' stays empty (draws nothing) until its upload on the GL thread.
+    // 'asStatic' uploads into one StaticBatch (the map) instead of a VAO per mesh.
+    void Request(const std::string& path, bool withCollision, GpuModel& target, bool asStatic = false) {
+        ModelJob job;
+        job.path = path;
+        job.target = &target;
+        job.asStatic = asStatic;
+        job.data = gWorkers.Submit([path, withCollision] {
+            auto data = std::make_unique<ModelData>();
+            if (!LoadModelData(path, withCollision, *data)) data.reset();
+            return data;
+        });
+        models.push_back(std::move(job));
+    }
+
+    // GL thread, once per frame: start decodes for newly parsed models and upload what is
+    // complete, stopping after budgetMs so the loading screen keeps presenting.
+    void Pump(double budgetMs) {
+        auto t0 = std::chrono::steady_clock::now();
+        auto spent = [&] { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+
+        for (auto& m : models) {
+            if (m.state != ModelJob::Parsing || !IsReady(m.data)) continue;
+            m.cpu = m.data.get();
+            if (!m.cpu) { std::cout << "[Load] failed: " << m.path << "\n"; m.state = ModelJob::Failed; continue; }
+            for (const auto& mesh : m.cpu->meshes) {
+                for (const auto& ref : mesh.textures) {
+                    std::string full = m.cpu->directory + '/' + ref.path;
+                    if (textures.count(full)) continue;
+                    TextureJob& tj = textures[full];
+                    tj.image = gWorkers.Submit([full] { return DecodeImage(full); });
+                }
+            }
+            m.state = ModelJob::Decoding;
+        }
+
+        for (auto& [full, tj] : textures) {
+            if (tj.uploaded || !IsReady(tj.image)) continue;
+            if (spent() > budgetMs) return;
+            DecodedImage img = tj.image.get();
+            Texture t;
+            t.id = UploadImage(img, full);
+            t.path = full;
+            gTexturesLoaded.push_back(t);
+            tj.uploaded = true;
+        }
+
+        for (auto& m : models) {
+            if (m.state != ModelJob::Decoding || !TexturesUploaded(*m.cpu)) continue;
+            if (spent() > budgetMs) return;
+            *m.target = m.asStatic ? UploadStaticModel(*m.cpu) : UploadModel(*m.cpu);
+            m.state = ModelJob::Uploaded;
+        }
+    }
+
+    // CPU-side data once parsed (map collision needs it before the GL upload is done)
+    ModelData* Data(const GpuModel& target) {
+        for (auto& m : models) if (m.target == &target) return m.cpu.get();
+        return nullptr;
+    }
+    bool Uploaded(const GpuModel& target) const {
+        for (const auto& m : models) if (m.target == &target) return m.state == ModelJob::Uploaded;
+        return false;
+    }
+    bool Failed(const GpuModel& target) const {
+        for (const auto& m : models) if (m.target == &target) return m.state == ModelJob::Failed;
+        return false;
+    }
+    bool AllDone() const {
+        for (const auto& m : models) if (m.state != ModelJob::Uploaded && m.state != ModelJob::Failed) return false;
+        return true;
+    }
+    int Completed() const {
+        int n = 0;
+        for (const auto& m : models) n += (m.state == ModelJob::Uploaded || m.state == ModelJob::Failed);
+        for (const auto& t : textures) n += t.second.uploaded;
+        return n;
+    }
+    int Total() const { return (int)(models.size() + textures.size()); }
+
+private:
+    struct ModelJob {
+        enum State { Parsing, Decoding, Uploaded, Failed };
+        std::string path;
+        GpuModel* target = nullptr;
+        bool asStatic = false;
+        std::future<std::unique_ptr<ModelData>> data;
+        std::unique_ptr<ModelData> cpu;
+        State state = Parsing;
+    };
+    struct TextureJob {
+        std::future<DecodedImage> image;
+        bool uploaded = false;
+    };
+
+    template <class T> static bool IsReady(std::future<T>& f) {
+        return f.valid() && f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    bool TexturesUploaded(const ModelData& data) const {
+        for (const auto& mesh : data.meshes)
+            for (const auto& ref : mesh.textures) {
+                auto it = textures.find(data.directory + '/' + ref.path);
+                if (it == textures.end() || !it->second.uploaded) return false;
+            }
+        return true;
+    }
+
+    std::vector<ModelJob> models;
+    std::map<std::string, TextureJob> textures;
+};
+
+// Clear-only loading screen: background plus a progress bar, no shaders needed.
+void DrawLoadingScreen(GLFWwindow* window, float progress) {
+    int w, h;
+    glfwGetFramebufferSize(window, &w, &h);
+    glClearColor(0.06f, 0.07f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glEnable(GL_SCISSOR_TEST);
+    int barW = w / 2, barH = std::max(4, h / 60), x = (w - barW) / 2, y = h / 2 - barH / 2;
+    glScissor(x, y, barW, barH);
+    glClearColor(0.18f, 0.2f, 0.26f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glScissor(x, y, (int)(barW * glm::clamp(progress, 0.0f, 1.0f)), barH);
+    glClearColor(0.85f, 0.72f, 0.35f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
 }
 
 // ---------- Callbacks ----------
@@ -244,8 +762,6 @@ void mouse_callback(GLFWwindow*, double xposIn, double yposIn) {
     gCamYawDeg += xoffset * sens;
     gCamPitchDeg += yoffset * sens;
     gCamPitchDeg = glm::clamp(gCamPitchDeg, -45.0f, 10.0f);
-
-    gPlayerYawDeg = gCamYawDeg;
 }
 void scroll_callback(GLFWwindow*, double, double y) { camera.ProcessMouseScroll((float)y); }
 void mouse_button_callback(GLFWwindow*, int button, int action, int) {
@@ -256,44 +772,30 @@ bool keyDown(GLFWwindow* w, int k) { return glfwGetKey(w, k) == GLFW_PRESS; }
 void updateWindowTitleWithBias(GLFWwindow* window) {
     std::string title = "Center TPS (Map OBJ) | PlayerBias=" + std::to_string(PLAYER_FOOT_BIAS)
         + " EnemyBias=" + std::to_string(ENEMY_FOOT_BIAS)
-        + " MapY=" + std::to_string(MAP_Y_OFFSET);
+        + " MapY=" + std::to_string(MAP_Y_OFFSET)
+        + " MapYaw=" + std::to_string(MAP_YAW_DEG)
+        + " MapScale=" + std::to_string(MAP_SCALE);
     glfwSetWindowTitle(window, title.c_str());
+    gTitleHoldUntil = glfwGetTime() + 2.0;
 }
 
-// Move with step-up; fallback to AABB push resolve
-bool TryMoveWithStepUp(glm::vec3& posXZ, const glm::vec3& moveXZ, float currentFootY,
-    AABB2D& playerBox, float& outNewFootY)
-{
-    glm::vec3 candidate = posXZ + moveXZ;
-    AABB2D candBox = playerBox; candBox.center = { candidate.x, candidate.z };
-
-    bool collide = false;
-    for (const auto& w : gWalls) { if (IntersectsWallAtHeight(w, candBox, currentFootY)) { collide = true; break; } }
-
-    if (!collide) { // free move
-        posXZ = candidate; playerBox.center = candBox.center;
-        outNewFootY = currentFootY;
-        return true;
-    }
-
-    // allow step-up if new floor is slightly higher
-    float newFloorY = SampleFloorY(candidate);
-    float diff = newFloorY - currentFootY;
-    if (diff > -STEP_SNAP_EPS && diff <= STEP_MAX) {
-        // also make sure at new height we aren't inside walls
-        bool collideNew = false;
-        for (const auto& w : gWalls) { if (IntersectsWallAtHeight(w, candBox, newFloorY)) { collideNew = true; break; } }
-        if (!collideNew) {
-            posXZ = candidate; playerBox.center = candBox.center;
-            outNewFootY = newFloorY;
-            return true;
-        }
-    }
-    return false;
+// Live keyboard/mouse state for one tick (replays read InputFrames from the file instead)
+InputFrame SampleInput(GLFWwindow* w) {
+    InputFrame in;
+    if (keyDown(w, GLFW_KEY_W)) in.buttons |= IN_FORWARD;
+    if (keyDown(w, GLFW_KEY_S)) in.buttons |= IN_BACK;
+    if (keyDown(w, GLFW_KEY_A)) in.buttons |= IN_LEFT;
+    if (keyDown(w, GLFW_KEY_D)) in.buttons |= IN_RIGHT;
+    if (keyDown(w, GLFW_KEY_LEFT_SHIFT)) in.buttons |= IN_SPRINT;
+    if (keyDown(w, GLFW_KEY_SPACE)) in.buttons |= IN_JUMP;
+    if (gShootHeld) in.buttons |= IN_SHOOT;
+    in.yaw = QuantizeYaw(gCamYawDeg);
+    return in;
 }
 
-void processInput(GLFWwindow* w, glm::vec3& playerPosXZ, AABB2D& playerBox,
-    float& playerFootY, bool& mapDirty)
+// UI and debug keys, once per rendered frame. Gameplay input goes through SampleInput.
+// Keys that change simulation results are ignored while recording or replaying.
+void processInput(GLFWwindow* w, bool& mapDirty, bool lockSimTuning)
 {
     if (keyDown(w, GLFW_KEY_ESCAPE)) glfwSetWindowShouldClose(w, true);
 
@@ -301,44 +803,42 @@ void processInput(GLFWwindow* w, glm::vec3& playerPosXZ, AABB2D& playerBox,
     if (f1Now && !f1Prev) { gWire = !gWire; glPolygonMode(GL_FRONT_AND_BACK, gWire ? GL_LINE : GL_FILL); }
     f1Prev = f1Now;
 
-    glm::vec3 forward = glm::normalize(glm::vec3(
-        std::sin(glm::radians(gCamYawDeg)), 0.0f, -std::cos(glm::radians(gCamYawDeg))
-    ));
-    glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0, 1, 0)));
-
-    glm::vec3 dir(0.0f);
-    if (keyDown(w, GLFW_KEY_W)) dir += forward;
-    if (keyDown(w, GLFW_KEY_S)) dir -= forward;
-    if (keyDown(w, GLFW_KEY_A)) dir -= right;
-    if (keyDown(w, GLFW_KEY_D)) dir += right;
-
-    float speed = gWalkSpeed * (keyDown(w, GLFW_KEY_LEFT_SHIFT) ? gSprintMul : 1.0f);
-    if (glm::length(dir) > 0.001f) {
-        dir = glm::normalize(dir);
-        glm::vec3 moveXZ = dir * speed * deltaTime;
-
-        float footYCandidate = playerFootY;
-        if (!TryMoveWithStepUp(playerPosXZ, moveXZ, playerFootY, playerBox, footYCandidate)) {
-            // multi-pass push-out to reduce corner sticking
-            AABB2D tmp = playerBox; tmp.center = { playerPosXZ.x, playerPosXZ.z };
-            for (int it = 0; it < UNSTICK_ITER; ++it) {
-                bool any = false;
-                for (const auto& w : gWalls) {
-                    if (IntersectsWallAtHeight(w, tmp, playerFootY)) { ResolveStaticWall(w, tmp, playerPosXZ); any = true; }
-                }
-                if (!any) break;
-            }
-            playerBox.center = tmp.center;
-        }
-        else {
-            playerFootY = footYCandidate;
-        }
+    static bool f2Prev = false; bool f2Now = keyDown(w, GLFW_KEY_F2);
+    if (f2Now && !f2Prev && !lockSimTuning) {
+        gUseHeightfield = !gUseHeightfield;
+        if (gUseHeightfield && gFloorHF.Empty()) BuildFloorHeightfield();
+        InvalidateFloorQueries();
+        std::cout << "[Heightfield] " << (gUseHeightfield ? "on" : "off") << "\n";
+    }
+    f2Prev = f2Now;
+
+    static bool f3Prev = false; bool f3Now = keyDown(w, GLFW_KEY_F3);
+    if (f3Now && !f3Prev) CompareTriKernels(256, true);
+    f3Prev = f3Now;
+
+    static bool f4Prev = false; bool f4Now = keyDown(w, GLFW_KEY_F4);
+    if (f4Now && !f4Prev) {
+        gProfileTitle = !gProfileTitle;
+        if (!gProfileTitle) glfwSetWindowTitle(w, "Center TPS (Map OBJ)");
+    }
+    f4Prev = f4Now;
+
+    static bool f5Prev = false; bool f5Now = keyDown(w, GLFW_KEY_F5);
+    if (f5Now && !f5Prev) {
+        if (gProfiler.Capturing()) gProfiler.StopCapture();
+        else gProfiler.StartCapture("profile_" + std::to_string(gCaptureIndex++));
     }
+    f5Prev = f5Now;
 
-    // jump
-    if (keyDown(w, GLFW_KEY_SPACE) && gGrounded) { gVelY = JUMP_FORCE; gGrounded = false; }
+    static bool f6Prev = false; bool f6Now = keyDown(w, GLFW_KEY_F6);
+    if (f6Now && !f6Prev) {
+        gOcclusionCulling = !gOcclusionCulling;
+        std::cout << "[Occlusion] " << (gOcclusionCulling ? "on" : "off") << "\n";
+    }
+    f6Prev = f6Now;
 
     // live tuning
+    if (lockSimTuning) return;
     static bool prevPgUp = false, prevPgDn = false, prevHome = false, prevEnd = false;
     bool pgUp = keyDown(w, GLFW_KEY_PAGE_UP);
     bool pgDn = keyDown(w, GLFW_KEY_PAGE_DOWN);
@@ -358,6 +858,17 @@ void processInput(GLFWwindow* w, glm::vec3& playerPosXZ, AABB2D& playerBox,
     if (U && !prevU) { MAP_Y_OFFSET += 0.10f; updateWindowTitleWithBias(w); mapDirty = true; }
     if (J && !prevJ) { MAP_Y_OFFSET -= 0.10f; updateWindowTitleWithBias(w); mapDirty = true; }
     prevU = U; prevJ = J;
+
+    static bool prevLB = false, prevRB = false, prevMinus = false, prevEqual = false;
+    bool LB = keyDown(w, GLFW_KEY_LEFT_BRACKET);
+    bool RB = keyDown(w, GLFW_KEY_RIGHT_BRACKET);
+    bool minusK = keyDown(w, GLFW_KEY_MINUS);
+    bool equalK = keyDown(w, GLFW_KEY_EQUAL);
+    if (LB && !prevLB) { MAP_YAW_DEG -= 5.0f; updateWindowTitleWithBias(w); mapDirty = true; }
+    if (RB && !prevRB) { MAP_YAW_DEG += 5.0f; updateWindowTitleWithBias(w); mapDirty = true; }
+    if (minusK && !prevMinus) { MAP_SCALE = std::max(0.1f, MAP_SCALE - 0.05f); updateWindowTitleWithBias(w); mapDirty = true; }
+    if (equalK && !prevEqual) { MAP_SCALE += 0.05f; updateWindowTitleWithBias(w); mapDirty = true; }
+    prevLB = LB; prevRB = RB; prevMinus = minusK; prevEqual = equalK;
 }
 
 // ---------- Follow camera ----------
@@ -375,34 +886,7 @@ void updateFollowCamera(const glm::vec3& playerPosAbs) {
     camera.Up = glm::normalize(glm::cross(camera.Right, camera.Front));
 }
 
-// Try to nudge spawn out of walls if initial position is blocked
-void NudgeSpawn(glm::vec3& posXZ, AABB2D& box, float& footY) {
-    auto blocked = [&](const glm::vec3& p)->bool {
-        AABB2D b = box; b.center = { p.x, p.z };
-        for (const auto& w : gWalls) if (IntersectsWallAtHeight(w, b, footY)) return true;
-        return false;
-        };
-    if (!blocked(posXZ)) return;
-
-    const float STEP = 0.5f;
-    for (int r = 1; r <= 40; ++r) {
-        for (int dx = -r; dx <= r; ++dx) {
-            for (int dz = -r; dz <= r; ++dz) {
-                glm::vec3 c = posXZ + glm::vec3(dx * STEP, 0, dz * STEP);
-                float y = SampleFloorY(c);
-                float f = y;
-                if (!blocked(c)) {
-                    posXZ = c; box.center = { c.x, c.z };
-                    footY = f;
-                    std::cout << "[Spawn] nudged to (" << c.x << "," << c.z << ")\n";
-                    return;
-                }
-            }
-        }
-    }
-}
-
-int main() {
+int main(int argc, char** argv) {
     // Window
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -424,178 +908,244 @@ int main() {
     stbi_set_flip_vertically_on_load(false);
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE); glCullFace(GL_BACK);
+    LoadMultiDrawIndirect(window);
+    gProfiler.BindThread();
+    GpuTimers gpuTimers;
+    gpuTimers.Init();
 
     Shader shader("1.model_loading.vs", "1.model_loading.fs");
-
-    Model playerModel(FileSystem::getPath("resources/objects/un/un.obj"));
-    Model enemyModel(FileSystem::getPath("resources/objects/cuphead/cuphead_rig.obj"));
-    Model itemModel(FileSystem::getPath("resources/objects/backpack/backpack.obj"));
-    Model ballModel(FileSystem::getPath("resources/objects/banana/banana.obj")); // used as bullet mesh
-    Model mapModel(FileSystem::getPath(MAP_MODEL_RELATIVE_PATH));
-
-    // Build colliders from map geometry
-    BuildMapCollision(mapModel);
+    Shader instancedShader("1.model_loading_instanced.vs", "1.model_loading.fs");
+    ShaderBinding meshBinding(shader), instancedBinding(instancedShader);
+    CameraUniforms cameraUniforms;
+    cameraUniforms.Init();
+
+    // Models are parsed (or mapped from their cook) and textures decoded on the worker pool;
+    // this thread keeps presenting a loading screen and only does the GL uploads.
+    auto loadStart = std::chrono::steady_clock::now();
+    int threadArg = 0;
+    for (int i = 1; i + 1 < argc; ++i)
+        if (std::string(argv[i]) == "--threads") threadArg = std::atoi(argv[i + 1]);
+    gWorkers.Start(ThreadCountFromArg(threadArg) - 1);
+    GpuModel playerModel, enemyModel, itemModel, ballModel, mapModel;
+    AssetLoader loader;
+    loader.Request(FileSystem::getPath(MAP_MODEL_RELATIVE_PATH), true, mapModel, true);
+    loader.Request(FileSystem::getPath("resources/objects/un/un.obj"), false, playerModel);
+    loader.Request(FileSystem::getPath("resources/objects/cuphead/cuphead_rig.obj"), false, enemyModel);
+    loader.Request(FileSystem::getPath("resources/objects/backpack/backpack.obj"), false, itemModel);
+    loader.Request(FileSystem::getPath("resources/objects/banana/banana.obj"), false, ballModel); // used as bullet mesh
+
+    // Stay on the loading screen until the map is on the GPU and its colliders are built;
+    // the small props may still be streaming in after that.
+    bool colliderStarted = false, colliderReady = false;
+    while (!loader.Uploaded(mapModel) || !colliderReady) {
+        if (glfwWindowShouldClose(window) || loader.Failed(mapModel)) {
+            if (loader.Failed(mapModel)) std::cout << "Failed to load map\n";
+            gWorkers.Stop(); glfwTerminate(); return -1;
+        }
+        loader.Pump(8.0);
+        if (!colliderStarted && loader.Data(mapModel)) { StartMapCollisionBuild(*loader.Data(mapModel)); colliderStarted = true; }
+        if (colliderStarted && !colliderReady) colliderReady = UpdateMapCollision();
+
+        float progress = (loader.Completed() + (colliderReady ? 1.0f : 0.0f)) / (loader.Total() + 1.0f);
+        DrawLoadingScreen(window, progress);
+        std::string title = "Center TPS (Map OBJ) | Loading " + std::to_string((int)(progress * 100.0f)) + "%";
+        glfwSetWindowTitle(window, title.c_str());
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+    glfwSetWindowTitle(window, "Center TPS (Map OBJ)");
+    std::cout << "[Load] startup " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count()
+        << " ms (map " << (loader.Data(mapModel)->cooked ? "cooked" : "imported") << ", " << gWorkers.Size() << " workers)\n";
 
     // State
     float playerScale = 1.0f;
     float enemyScale = 0.45f;
+    bool  mapDirty = false;
 
-    glm::vec3 playerPosXZ(0, 0, 0);
-    glm::vec3 enemyPosXZ(-6.f, 0.f, 2.f);
-    glm::vec3 itemPosXZ(2.f, 0.f, -4.f);
-
-    AABB2D playerBox{ {playerPosXZ.x,playerPosXZ.z},{0.40f,0.40f} };
-    AABB2D enemyBox{ {enemyPosXZ.x, enemyPosXZ.z },{0.45f,0.45f} };
-    AABB2D itemBox{ {itemPosXZ.x,  itemPosXZ.z  },{0.60f,0.60f} };
-
-    glm::vec3 playerAbs(0), enemyAbs(0), itemAbs(0);
-
-    float playerFootY = SampleFloorY(playerPosXZ);
-
-    // If spawn overlaps walls at this height, nudge to a nearby free spot
-    NudgeSpawn(playerPosXZ, playerBox, playerFootY);
+    // --record <file> saves every tick's input, --replay <file> plays one back instead of the keyboard/mouse
+    InputRecorder recorder;
+    InputPlayer   replay;
+    std::string recordPath;
+    for (int i = 1; i + 1 < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads") ++i;  // handled before the workers started
+        else if (arg == "--crowd") gCrowdSize = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--record") recordPath = argv[++i];
+        else if (arg == "--replay" && replay.Open(argv[++i])) {
+            gUseHeightfield = (replay.Flags() & REPLAY_HEIGHTFIELD) != 0;
+            if (gUseHeightfield && gFloorHF.Empty()) BuildFloorHeightfield();
+            gCrowdSize = (int)std::max(1u, replay.Enemies());
+        }
+    }
+    if (!recordPath.empty()) recorder.Open(recordPath, gUseHeightfield ? REPLAY_HEIGHTFIELD : 0u, (uint32_t)gCrowdSize);
 
-    playerAbs = { playerPosXZ.x, playerFootY + PLAYER_FOOT_BIAS, playerPosXZ.z };
+    GameState state;
+    ResetGameState(state);
 
-    bool  mapDirty = false;
-    int   enemyHP = 7;
-    float enemyAmp = 6.f, enemySpeed = 1.2f, enemyDir = 1.f;
-    bool  itemCollected = false;
+    InstanceBatch bulletBatch, enemyBatch;
+    bulletBatch.transforms.reserve(BULLET_CAPACITY);
+    enemyBatch.transforms.reserve(state.enemies.Size());
+    DrawQueue drawQueue;
+    OcclusionBuffer occlusion;
 
-    auto drawAbs = [&](Model& m, const glm::vec3& pAbs, float yawDeg, float s) {
+    auto drawAbs = [&](const GpuModel& m, const glm::vec3& pAbs, float yawDeg, float s) {
         glm::mat4 M(1.0f);
         M = glm::translate(M, pAbs);
         M = glm::rotate(M, glm::radians(yawDeg), glm::vec3(0, 1, 0));
         M = glm::scale(M, glm::vec3(s));
-        shader.setMat4("model", M);
-        m.Draw(shader);
+        drawQueue.Add(meshBinding, m, M);
         };
 
+    float  simAccum = 0.0f;
+    double simMsSum = 0.0, simMsMax = 0.0;
+    double nextTitle = 0.0;
+    lastFrame = (float)glfwGetTime();
     while (!glfwWindowShouldClose(window)) {
         float t = (float)glfwGetTime();
         deltaTime = t - lastFrame; lastFrame = t;
+        gProfiler.BeginFrame();
 
-        processInput(window, playerPosXZ, playerBox, playerFootY, mapDirty);
-        if (mapDirty) { BuildMapCollision(mapModel); mapDirty = false; }
-
-        // Anchor enemy & item to floor
-        {
-            float ey = SampleFloorY(enemyPosXZ);
-            enemyAbs = { enemyPosXZ.x, ey + ENEMY_FOOT_BIAS, enemyPosXZ.z };
-            float iy = SampleFloorY(itemPosXZ);
-            itemAbs = { itemPosXZ.x,  iy + 0.05f,            itemPosXZ.z };
-        }
-
-        // Vertical physics
-        gVelY -= GRAVITY * deltaTime;
-        float proposedY = playerAbs.y + gVelY * deltaTime;
-
-        float floorY = SampleFloorY(playerPosXZ);
-        float minY = floorY + PLAYER_FOOT_BIAS;
-
-        if (proposedY <= minY) {
-            playerAbs.y = minY;
-            gVelY = 0.0f;
-            gGrounded = true;
-            playerFootY = floorY;
+        if (!loader.AllDone()) {
+            PROFILE_SCOPE(PROF_LOAD);
+            loader.Pump(2.0);
         }
-        else {
-            playerAbs.y = proposedY;
-            gGrounded = false;
-        }
-        playerAbs.x = playerPosXZ.x;
-        playerAbs.z = playerPosXZ.z;
 
-        // Unstick pass (height-aware)
         {
-            AABB2D b = playerBox;
-            b.halfExt.x = std::max(0.01f, b.halfExt.x - SKIN);
-            b.halfExt.y = std::max(0.01f, b.halfExt.y - SKIN);
-
-            for (int it = 0; it < UNSTICK_ITER; ++it) {
-                bool any = false;
-                for (const auto& w : gWalls) {
-                    if (IntersectsWallAtHeight(w, b, playerFootY)) { ResolveStaticWall(w, b, playerPosXZ); any = true; }
+            PROFILE_SCOPE(PROF_INPUT);
+            processInput(window, mapDirty, recorder.Active() || replay.Active());
+        }
+        if (mapDirty) mapDirty = !UpdateMapCollision();
+
+        // Fixed-rate simulation; whatever is left over becomes the interpolation factor
+        simAccum += std::min(deltaTime, SIM_MAX_FRAME);
+        while (simAccum >= SIM_DT) {
+            InputFrame in;
+            if (replay.Active()) {
+                if (!replay.Next(in)) {
+                    uint64_t h = HashGameState(state);
+                    std::cout << "[Replay] " << state.tick << " ticks, sim avg " << simMsSum / std::max(1u, state.tick)
+                        << " ms, max " << simMsMax << " ms, final state "
+                        << (h == replay.ExpectedHash() ? "matches" : "DIFFERS FROM") << " the recording\n";
+                    glfwSetWindowShouldClose(window, true);
+                    break;
                 }
-                if (!any) break;
+                gCamYawDeg = YawDegrees(in.yaw);  // camera follows the recorded view
             }
-            playerBox.center = b.center;
-            playerAbs.x = playerPosXZ.x;
-            playerAbs.z = playerPosXZ.z;
-        }
-
-        // Step-down snap (smooth descent)
-        {
-            float newFloor = SampleFloorY(playerPosXZ);
-            float drop = playerFootY - newFloor;
-            if (gGrounded && drop > STEP_SNAP_EPS && drop <= STEP_DOWN_MAX) {
-                playerFootY = newFloor;
-                playerAbs.y = playerFootY + PLAYER_FOOT_BIAS;
+            else {
+                in = SampleInput(window);
             }
-        }
-
-        // Shooting
-        gShootCooldown -= deltaTime;
-        if (gShootHeld && gShootCooldown <= 0.0f) {
-            float yaw = glm::radians(gPlayerYawDeg);
-            glm::vec3 fwd = glm::normalize(glm::vec3(std::sin(yaw), 0.0f, -std::cos(yaw)));
-            Bullet b; b.pos = playerAbs + glm::vec3(0, 0.5f, 0) + fwd * 0.9f;
-            b.vel = fwd * 20.0f; b.life = 4.0f; b.radius = 0.2f; b.active = true;
-            gBullets.push_back(b); gShootCooldown = 0.12f;
-        }
+            if (recorder.Active()) recorder.Write(in);
 
-        // Enemy patrolling (demo)
-        enemyPosXZ.x += enemyDir * enemySpeed * deltaTime;
-        if (enemyPosXZ.x > -6.f + enemyAmp) enemyDir = -1.f;
-        if (enemyPosXZ.x < -6.f - enemyAmp) enemyDir = 1.f;
-
-        // Item pickup
-        itemBox.center = { itemPosXZ.x, itemPosXZ.z };
-        if (!itemCollected && IntersectsXZ(playerBox, itemBox)) { itemCollected = true; gWalkSpeed = 12.0f; }
-
-        // Bullet hits
-        enemyBox.center = { enemyPosXZ.x, enemyPosXZ.z };
-        for (auto& b : gBullets) if (b.active) {
-            b.pos += b.vel * deltaTime;
-            b.life -= deltaTime;
-            if (b.life <= 0.0f) b.active = false;
-            AABB2D bb{ {b.pos.x,b.pos.z},{b.radius,b.radius} };
-            if (b.active && IntersectsXZ(bb, enemyBox)) { b.active = false; enemyHP--; }
+            auto simStart = std::chrono::steady_clock::now();
+            {
+                PROFILE_SCOPE(PROF_SIM);
+                SimulateTick(state, in, SIM_DT);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - simStart).count();
+            simMsSum += ms; simMsMax = std::max(simMsMax, ms);
+            simAccum -= SIM_DT;
         }
-        gBullets.erase(std::remove_if(gBullets.begin(), gBullets.end(),
-            [](const Bullet& b) { return !b.active; }), gBullets.end());
-        if (enemyHP <= 0) { enemyHP = 7; enemyPosXZ = glm::vec3(-6.f, 0.f, 2.f); }
+        float alpha = glm::clamp(simAccum / SIM_DT, 0.0f, 1.0f);
+        glm::vec3 playerDraw = glm::mix(state.prevPlayerAbs, state.playerAbs, alpha);
 
         // ---------- Render ----------
+        std::optional<ProfScope> renderScope(std::in_place, PROF_RENDER);
+        gpuTimers.BeginFrame();
         glClearColor(0.06f, 0.07f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        gGL.Reset();
 
-        shader.use();
         float farPlane = 600.0f;
         glm::mat4 P = glm::perspective(glm::radians(camera.Zoom),
             (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, farPlane);
-        shader.setMat4("projection", P);
-        shader.setMat4("view", camera.GetViewMatrix());
-
-        updateFollowCamera(playerAbs);
+        glm::mat4 V = camera.GetViewMatrix();
+        cameraUniforms.Update(P, V);
+        Frustum frustum(P * V);
+
+        updateFollowCamera(playerDraw);
+
+        // Occluders for this camera, before anything is submitted. They come with the collider,
+        // so none while a rebuild for a new map placement is still running.
+        OcclusionBuffer* occ = nullptr;
+        if (gOcclusionCulling && !mapDirty) {
+            occlusion.Render(P * V, gOccluders);
+            occ = &occlusion;
+        }
 
-        // Map
+        // Map: one multi-draw per texture group over the chunks inside the view frustum
+        // and not hidden behind an occluder
         {
             glm::mat4 M = MapTransform();
-            shader.setMat4("model", M);
-            mapModel.Draw(shader);
+            meshBinding.Use();
+            meshBinding.SetModel(M);
+            gpuTimers.Begin(GPU_MAP);
+            mapModel.batch.Draw(M, frustum, occ);
+            gpuTimers.End(GPU_MAP);
+            gProfiler.SetCounter(PROF_MAP_DRAWN, mapModel.batch.drawn);
+            gProfiler.SetCounter(PROF_MAP_CULLED, mapModel.batch.culled);
+            gProfiler.SetCounter(PROF_MAP_DRAWS, mapModel.batch.draws);
         }
 
-        if (!itemCollected) drawAbs(itemModel, itemAbs, 0.0f, 0.85f);
-        drawAbs(enemyModel, enemyAbs, t * 30.0f, enemyScale);
-        drawAbs(playerModel, playerAbs, gPlayerYawDeg, playerScale);
+        gpuTimers.Begin(GPU_ACTORS);
+        if (!state.itemCollected) {
+            glm::vec3 lo = state.itemAbs + itemModel.bmin * 0.85f, hi = state.itemAbs + itemModel.bmax * 0.85f;
+            if (!occ || !occ->Occluded(lo, hi)) drawAbs(itemModel, state.itemAbs, 0.0f, 0.85f);
+        }
+        drawAbs(playerModel, playerDraw, state.playerYawDeg, playerScale);
+        drawQueue.Flush();
+        gpuTimers.End(GPU_ACTORS);
 
-        for (auto& b : gBullets) if (b.active) drawAbs(ballModel, b.pos, 0.0f, 0.025f);
+        // Enemies: all share one spin, so only the translation differs per instance.
+        // Each is culled as a box from its feet to the top of its hit volume.
+        instancedBinding.Use();
+        {
+            glm::mat4 spin = glm::scale(glm::rotate(glm::mat4(1.0f), glm::radians(t * 30.0f), glm::vec3(0, 1, 0)), glm::vec3(enemyScale));
+            glm::vec3 lo(-ENEMY_HALF_EXT, -ENEMY_FOOT_BIAS, -ENEMY_HALF_EXT);
+            glm::vec3 hi(ENEMY_HALF_EXT, ENEMY_HIT_HEIGHT - ENEMY_FOOT_BIAS, ENEMY_HALF_EXT);
+            enemyBatch.transforms.clear();
+            for (size_t i = 0; i < state.enemies.Size(); ++i) {
+                glm::vec3 p = state.enemies.Lerp(i, alpha);
+                if (!frustum.Intersects(p + lo, p + hi)) continue;
+                if (occ && occ->Occluded(p + lo, p + hi)) continue;
+                enemyBatch.transforms.push_back(spin);
+                enemyBatch.transforms.back()[3] = glm::vec4(p, 1.0f);
+            }
+            gpuTimers.Begin(GPU_CROWD);
+            enemyBatch.Draw(enemyModel);
+            gpuTimers.End(GPU_CROWD);
+            gProfiler.SetCounter(PROF_CROWD_DRAWN, (int)enemyBatch.transforms.size());
+        }
+        gProfiler.SetCounter(PROF_OCCLUDERS, occ ? occlusion.occludersDrawn : 0);
+        gProfiler.SetCounter(PROF_OCC_CULLED, occ ? occlusion.culled : 0);
+
+        // Bullets: one instanced draw per mesh
+        bulletBatch.transforms.clear();
+        for (int b : state.bullets.live)
+            bulletBatch.transforms.push_back(glm::scale(glm::translate(glm::mat4(1.0f), state.bullets.Lerp(b, alpha)), glm::vec3(0.025f)));
+        gpuTimers.Begin(GPU_BULLETS);
+        bulletBatch.Draw(ballModel);
+        gpuTimers.End(GPU_BULLETS);
+        gProfiler.SetCounter(PROF_PROGRAM_BINDS, gGL.programBinds);
+        gProfiler.SetCounter(PROF_TEXTURE_BINDS, gGL.textureBinds);
+        renderScope.reset();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            PROFILE_SCOPE(PROF_SWAP);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        gProfiler.EndFrame();
+
+        if (gProfileTitle && t >= nextTitle && t >= gTitleHoldUntil) {
+            std::string title = "Center TPS | " + gProfiler.Summary();
+            glfwSetWindowTitle(window, title.c_str());
+            nextTitle = t + 0.5;
+        }
     }
 
+    gProfiler.StopCapture();
+    recorder.Close(HashGameState(state));
+    gWorkers.Stop();
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,654 @@
+// Navigation: a layered walkable grid built from the floor triangles and wall boxes, split
+// into clusters for hierarchical A* (HPA*), and a planner that answers path requests from a
+// cache or works through a queue of searches on a fixed budget per tick. No GL in here.
+// Header-only: include it from one translation unit per executable.
+#ifndef NAVIGATION_H
+#define NAVIGATION_H
+
+#include "map_collision.h"
+#include "worker_pool.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// ---------- Navigation grid ----------
+// Every NAV_CELL square gets one node per floor layer under its center: floor triangles are
+// rasterized at cell centers, heights closer than NAV_LAYER_MERGE are one layer, and a layer
+// with another one less than the agent's height above it is dropped. A node is walkable when
+// an agent box centered on the cell hits no wall box at that foot height, the same test the
+// movement code uses. The box is at least a cell wide, so neighbouring walkable cells have
+// no wall between their centers. Edges go to the 8 neighbours whose layer is within the
+// agent's step up / step down (diagonals only when both sides are open), so the graph is
+// directed where a drop is too high to climb back.
+const float    NAV_CELL = 0.5f;
+const float    NAV_LAYER_MERGE = 0.25f;
+const int      NAV_CLUSTER = 16;          // cells per cluster side
+const int      NAV_ENTRANCE_SPLIT = 6;    // border openings this long get a transition at each end
+const size_t   NAV_MAX_CELLS = 16u << 20; // no navigation on absurd extents
+const size_t   NAV_BLOCK_GRAIN = 4096;    // cells per ParallelFor chunk for the wall test
+const uint32_t NAV_NONE = 0xFFFFFFFFu;
+
+// What the grid is built for: half extent of the agent box, climbable step up / step down and
+// the headroom it needs.
+struct NavAgent { float halfExt, stepUp, stepDown, height; };
+
+struct NavMesh {
+    glm::vec2 origin{ 0.0f };
+    int       nx = 0, nz = 0;
+    std::vector<uint32_t> cellFirst;   // nodes of cell c: [cellFirst[c], cellFirst[c + 1])
+    std::vector<float>    nodeY;       // floor height at the cell center
+    std::vector<uint32_t> nodeCell, nodeCluster;
+    std::vector<uint32_t> outFirst, outTo;  std::vector<float> outCost;   // edges, by source
+    std::vector<uint32_t> inFirst, inFrom;  std::vector<float> inCost;    // same edges, by target
+
+    // Abstract graph: one node per cluster-border transition, edges across borders and
+    // between the transitions of a cluster (cost of the best path inside it).
+    int cnx = 0, cnz = 0;
+    std::vector<uint32_t> absOf;       // node -> abstract node or NAV_NONE
+    std::vector<uint32_t> absNode;     // abstract node -> node
+    std::vector<uint32_t> clusterFirst, clusterAbs;  // abstract nodes per cluster
+    std::vector<uint32_t> absFirst, absTo;  std::vector<float> absCost;
+
+    NavAgent agent{};
+    uint32_t colliderBuild = 0;        // gColliderBuild the grid was installed with, 0 before the first one
+    float    yOffset = 0.0f;           // gAppliedPlacement.yOffset the heights are for
+    double   buildMs = 0.0;
+
+    bool     Empty() const { return nodeY.empty(); }
+    size_t   Nodes() const { return nodeY.size(); }
+    size_t   Cells() const { return (size_t)nx * nz; }
+    bool     StepOk(float fromY, float toY) const { return toY - fromY <= agent.stepUp && fromY - toY <= agent.stepDown; }
+
+    glm::vec2 CellCenter(uint32_t cell) const {
+        return origin + glm::vec2((cell % nx) + 0.5f, (cell / nx) + 0.5f) * NAV_CELL;
+    }
+    glm::vec2 NodeXZ(uint32_t node) const { return CellCenter(nodeCell[node]); }
+
+    // Octile distance between cell centers: never more than the path cost.
+    float Heuristic(uint32_t a, uint32_t b) const {
+        int ca = (int)nodeCell[a], cb = (int)nodeCell[b];
+        int dx = std::abs(ca % nx - cb % nx), dz = std::abs(ca / nx - cb / nx);
+        return NAV_CELL * (std::max(dx, dz) + 0.41421356f * std::min(dx, dz));
+    }
+
+    // The layer of the cell under (x, z) closest to footY, or NAV_NONE.
+    uint32_t NodeAt(float x, float z, float footY) const {
+        if (Empty()) return NAV_NONE;
+        int cx = (int)std::floor((x - origin.x) / NAV_CELL), cz = (int)std::floor((z - origin.y) / NAV_CELL);
+        if (cx < 0 || cz < 0 || cx >= nx || cz >= nz) return NAV_NONE;
+        uint32_t c = (uint32_t)(cz * nx + cx), best = NAV_NONE;
+        float bestDy = std::numeric_limits<float>::max();
+        for (uint32_t n = cellFirst[c]; n < cellFirst[c + 1]; ++n) {
+            float dy = std::fabs(nodeY[n] - footY);
+            if (dy < bestDy) { bestDy = dy; best = n; }
+        }
+        return best;
+    }
+
+    // NodeAt, else the closest node in growing square rings up to 'rings' cells out.
+    uint32_t Nearest(float x, float z, float footY, int rings) const {
+        uint32_t n = NodeAt(x, z, footY);
+        for (int r = 1; n == NAV_NONE && r <= rings; ++r) {
+            float bestD = std::numeric_limits<float>::max();
+            for (int dz = -r; dz <= r; ++dz)
+                for (int dx = -r; dx <= r; ++dx) {
+                    if (std::abs(dx) != r && std::abs(dz) != r) continue;
+                    uint32_t m = NodeAt(x + dx * NAV_CELL, z + dz * NAV_CELL, footY);
+                    if (m == NAV_NONE) continue;
+                    glm::vec2 d = NodeXZ(m) - glm::vec2(x, z);
+                    float dd = glm::dot(d, d) + (nodeY[m] - footY) * (nodeY[m] - footY);
+                    if (dd < bestD) { bestD = dd; n = m; }
+                }
+        }
+        return n;
+    }
+
+    void SetYOffset(float y) {
+        float dy = y - yOffset;
+        for (float& h : nodeY) h += dy;
+        yOffset = y;
+    }
+
+    void Build(const std::vector<Tri>& floors, const CompactWalls& walls, const WallGrid& grid,
+               const NavAgent& a, float yOff);
+
+private:
+    void BuildCells(const std::vector<Tri>& floors, const CompactWalls& walls, const WallGrid& grid);
+    void BuildEdges();
+    void BuildAbstract();
+};
+
+// ---------- Search ----------
+// Scratch for one A* or Dijkstra over n nodes. Stamps stand in for clearing the arrays, and
+// the open list is a binary heap ordered by (f, node) so ties always break the same way.
+struct NavScratch {
+    std::vector<float>    g;
+    std::vector<uint32_t> parent, seen, closed;
+    std::vector<std::pair<float, uint32_t>> open;
+    uint32_t stamp = 0;
+
+    void Begin(size_t n) {
+        if (seen.size() != n) { g.assign(n, 0.0f); parent.assign(n, NAV_NONE); seen.assign(n, 0); closed.assign(n, 0); stamp = 0; }
+        if (++stamp == 0) { std::fill(seen.begin(), seen.end(), 0u); std::fill(closed.begin(), closed.end(), 0u); stamp = 1; }
+        open.clear();
+    }
+    bool Reached(uint32_t n) const { return seen[n] == stamp; }
+    void Push(uint32_t n, float gn, float f, uint32_t from) {
+        if (seen[n] == stamp && gn >= g[n]) return;
+        seen[n] = stamp; g[n] = gn; parent[n] = from;
+        open.push_back({ f, n });
+        std::push_heap(open.begin(), open.end(), std::greater<>());
+    }
+    // Next unclosed node, or NAV_NONE when the open list is empty.
+    uint32_t Pop() {
+        while (!open.empty()) {
+            std::pop_heap(open.begin(), open.end(), std::greater<>());
+            uint32_t n = open.back().second;
+            open.pop_back();
+            if (closed[n] == stamp) continue;
+            closed[n] = stamp;
+            return n;
+        }
+        return NAV_NONE;
+    }
+};
+
+// A* from start to goal (Dijkstra over the whole cluster when goal is NAV_NONE) through the
+// nodes of one cluster. 'reverse' walks edges backwards, i.e. finds paths *to* start.
+// Returns the number of nodes expanded; s.Reached(goal) tells whether it was found.
+inline int SearchCluster(const NavMesh& nav, NavScratch& s, uint32_t start, uint32_t goal, bool reverse) {
+    uint32_t cluster = nav.nodeCluster[start];
+    s.Begin(nav.Nodes());
+    s.Push(start, 0.0f, 0.0f, NAV_NONE);
+    int expanded = 0;
+    for (uint32_t u; (u = s.Pop()) != NAV_NONE;) {
+        ++expanded;
+        if (u == goal) break;
+        const std::vector<uint32_t>& first = reverse ? nav.inFirst : nav.outFirst;
+        const std::vector<uint32_t>& to = reverse ? nav.inFrom : nav.outTo;
+        const std::vector<float>& cost = reverse ? nav.inCost : nav.outCost;
+        for (uint32_t e = first[u]; e < first[u + 1]; ++e) {
+            uint32_t v = to[e];
+            if (nav.nodeCluster[v] != cluster) continue;
+            float gv = s.g[u] + cost[e];
+            s.Push(v, gv, goal == NAV_NONE ? gv : gv + nav.Heuristic(v, goal), u);
+        }
+    }
+    return expanded;
+}
+
+// ---------- Navigation grid build ----------
+void NavMesh::Build(const std::vector<Tri>& floors, const CompactWalls& walls, const WallGrid& grid,
+                    const NavAgent& a, float yOff) {
+    auto t0 = std::chrono::steady_clock::now();
+    *this = NavMesh();
+    agent = a;
+    yOffset = yOff;
+    BuildCells(floors, walls, grid);
+    BuildEdges();
+    BuildAbstract();
+    buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "[Nav] " << nx << "x" << nz << " cells, " << Nodes() << " nodes, " << outTo.size() << " edges, "
+        << cnx * cnz << " clusters, " << absNode.size() << " transitions, " << absTo.size() << " abstract edges, "
+        << buildMs << " ms\n";
+}
+
+void NavMesh::BuildCells(const std::vector<Tri>& floors, const CompactWalls& walls, const WallGrid& grid) {
+    if (floors.empty()) return;
+    glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+    for (const Tri& t : floors) {
+        for (const glm::vec3* p : { &t.a, &t.b, &t.c }) {
+            lo = glm::min(lo, glm::vec2(p->x, p->z));
+            hi = glm::max(hi, glm::vec2(p->x, p->z));
+        }
+    }
+    origin = lo;
+    nx = (int)std::ceil((hi.x - lo.x) / NAV_CELL) + 1;
+    nz = (int)std::ceil((hi.y - lo.y) / NAV_CELL) + 1;
+    if (Cells() > NAV_MAX_CELLS) {
+        std::cout << "[Nav] " << nx << "x" << nz << " cells is too many, no navigation\n";
+        nx = nz = 0;
+        return;
+    }
+
+    // floor heights at cell centers, as (cell, y)
+    std::vector<std::pair<uint32_t, float>> hits;
+    for (const Tri& t : floors) {
+        glm::vec2 a(t.a.x, t.a.z), b(t.b.x, t.b.z), c(t.c.x, t.c.z);
+        float det = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::fabs(det) < 1e-12f) continue;
+        glm::vec2 tlo = glm::min(a, glm::min(b, c)), thi = glm::max(a, glm::max(b, c));
+        int x0 = std::max(0, (int)std::ceil((tlo.x - origin.x) / NAV_CELL - 0.5f));
+        int x1 = std::min(nx - 1, (int)std::floor((thi.x - origin.x) / NAV_CELL - 0.5f));
+        int z0 = std::max(0, (int)std::ceil((tlo.y - origin.y) / NAV_CELL - 0.5f));
+        int z1 = std::min(nz - 1, (int)std::floor((thi.y - origin.y) / NAV_CELL - 0.5f));
+        const float EDGE_EPS = -1e-5f;  // shared edges: a center on one counts for both triangles
+        for (int z = z0; z <= z1; ++z)
+            for (int x = x0; x <= x1; ++x) {
+                glm::vec2 p = CellCenter((uint32_t)(z * nx + x));
+                float u = ((b.x - p.x) * (c.y - p.y) - (b.y - p.y) * (c.x - p.x)) / det;
+                float v = ((c.x - p.x) * (a.y - p.y) - (c.y - p.y) * (a.x - p.x)) / det;
+                float w = 1.0f - u - v;
+                if (u < EDGE_EPS || v < EDGE_EPS || w < EDGE_EPS) continue;
+                hits.push_back({ (uint32_t)(z * nx + x), u * t.a.y + v * t.b.y + w * t.c.y });
+            }
+    }
+    std::sort(hits.begin(), hits.end());
+
+    // layers per cell (highest height of each merged run), minus the ones without headroom
+    std::vector<std::pair<uint32_t, float>> layers;
+    for (size_t i = 0; i < hits.size();) {
+        size_t first = layers.size();
+        uint32_t cell = hits[i].first;
+        for (; i < hits.size() && hits[i].first == cell; ++i) {
+            if (layers.size() > first && hits[i].second - layers.back().second <= NAV_LAYER_MERGE) layers.back().second = hits[i].second;
+            else layers.push_back(hits[i]);
+        }
+        size_t kept = first;
+        for (size_t k = first; k < layers.size(); ++k)
+            if (k + 1 == layers.size() || layers[k + 1].second - layers[k].second >= agent.height) layers[kept++] = layers[k];
+        layers.resize(kept);
+    }
+
+    // wall test per layer (the bulk of the build), then compact into nodes
+    std::vector<uint8_t> open(layers.size());
+    float half = std::max(NAV_CELL * 0.5f, agent.halfExt);
+    ParallelFor(layers.size(), NAV_BLOCK_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            AABB2D box{ CellCenter(layers[k].first), { half, half } };
+            open[k] = !grid.Query(walls, box, layers[k].second, [](const WallBox&) { return true; });
+        }
+        });
+    cellFirst.assign(Cells() + 1, 0);
+    for (size_t k = 0; k < layers.size(); ++k) {
+        if (!open[k]) continue;
+        cellFirst[layers[k].first + 1]++;
+        nodeY.push_back(layers[k].second);
+        nodeCell.push_back(layers[k].first);
+    }
+    for (size_t c = 0; c < Cells(); ++c) cellFirst[c + 1] += cellFirst[c];
+}
+
+void NavMesh::BuildEdges() {
+    if (Empty()) { cellFirst.clear(); return; }
+    cnx = (nx + NAV_CLUSTER - 1) / NAV_CLUSTER;
+    cnz = (nz + NAV_CLUSTER - 1) / NAV_CLUSTER;
+    nodeCluster.resize(Nodes());
+    for (uint32_t n = 0; n < Nodes(); ++n) {
+        int cx = (int)(nodeCell[n] % nx), cz = (int)(nodeCell[n] / nx);
+        nodeCluster[n] = (uint32_t)((cz / NAV_CLUSTER) * cnx + cx / NAV_CLUSTER);
+    }
+
+    // any layer of cell (x, z) reachable from height y
+    auto reach = [&](int x, int z, float y) {
+        if (x < 0 || z < 0 || x >= nx || z >= nz) return false;
+        uint32_t c = (uint32_t)(z * nx + x);
+        for (uint32_t m = cellFirst[c]; m < cellFirst[c + 1]; ++m) if (StepOk(y, nodeY[m])) return true;
+        return false;
+    };
+    outFirst.assign(Nodes() + 1, 0);
+    for (uint32_t n = 0; n < Nodes(); ++n) {
+        int x = (int)(nodeCell[n] % nx), z = (int)(nodeCell[n] / nx);
+        for (int dz = -1; dz <= 1; ++dz)
+            for (int dx = -1; dx <= 1; ++dx) {
+                if (!dx && !dz) continue;
+                if (x + dx < 0 || z + dz < 0 || x + dx >= nx || z + dz >= nz) continue;
+                if (dx && dz && (!reach(x + dx, z, nodeY[n]) || !reach(x, z + dz, nodeY[n]))) continue;
+                uint32_t c = (uint32_t)((z + dz) * nx + x + dx);
+                for (uint32_t m = cellFirst[c]; m < cellFirst[c + 1]; ++m) {
+                    if (!StepOk(nodeY[n], nodeY[m])) continue;
+                    outTo.push_back(m);
+                    outCost.push_back(dx && dz ? NAV_CELL * 1.41421356f : NAV_CELL);
+                }
+            }
+        outFirst[n + 1] = (uint32_t)outTo.size();
+    }
+
+    inFirst.assign(Nodes() + 1, 0);
+    for (uint32_t m : outTo) inFirst[m + 1]++;
+    for (size_t n = 0; n < Nodes(); ++n) inFirst[n + 1] += inFirst[n];
+    inFrom.resize(outTo.size());
+    inCost.resize(outTo.size());
+    std::vector<uint32_t> fill(inFirst.begin(), inFirst.end() - 1);
+    for (uint32_t n = 0; n < Nodes(); ++n)
+        for (uint32_t e = outFirst[n]; e < outFirst[n + 1]; ++e) {
+            uint32_t k = fill[outTo[e]]++;
+            inFrom[k] = n;
+            inCost[k] = outCost[e];
+        }
+}
+
+// Transitions: along each border between two clusters, node pairs linked across it are
+// grouped into openings (runs of neighbouring pairs that are linked to each other too). Each
+// opening gets one transition in its middle, or one at each end when it is long.
+void NavMesh::BuildAbstract() {
+    if (Empty()) return;
+    absOf.assign(Nodes(), NAV_NONE);
+    struct Link { uint32_t from, to; float cost; };
+    std::vector<Link> links;
+    auto edgeCost = [&](uint32_t u, uint32_t v) {
+        for (uint32_t e = outFirst[u]; e < outFirst[u + 1]; ++e) if (outTo[e] == v) return outCost[e];
+        return -1.0f;
+    };
+    auto makeAbs = [&](uint32_t n) {
+        if (absOf[n] == NAV_NONE) { absOf[n] = (uint32_t)absNode.size(); absNode.push_back(n); }
+        return absOf[n];
+    };
+    auto addTransition = [&](uint32_t u, uint32_t v) {
+        float uv = edgeCost(u, v), vu = edgeCost(v, u);
+        uint32_t au = makeAbs(u), av = makeAbs(v);
+        if (uv >= 0.0f) links.push_back({ au, av, uv });
+        if (vu >= 0.0f) links.push_back({ av, au, vu });
+    };
+
+    struct Pair { uint32_t u, v; };
+    struct Opening { std::vector<Pair> pairs; int last; };
+    // cells (x, z) | (x + ox, z + oz) for i along the border, stepping (sx, sz)
+    auto scanBorder = [&](int x, int z, int ox, int oz, int sx, int sz, int count) {
+        std::vector<Opening> openings, done;
+        for (int i = 0; i < count; ++i, x += sx, z += sz) {
+            if (x + ox >= nx || z + oz >= nz || x >= nx || z >= nz) break;
+            uint32_t ca = (uint32_t)(z * nx + x), cb = (uint32_t)((z + oz) * nx + x + ox);
+            for (uint32_t u = cellFirst[ca]; u < cellFirst[ca + 1]; ++u)
+                for (uint32_t v = cellFirst[cb]; v < cellFirst[cb + 1]; ++v) {
+                    if (edgeCost(u, v) < 0.0f && edgeCost(v, u) < 0.0f) continue;
+                    Opening* o = nullptr;
+                    for (Opening& cand : openings)
+                        if (cand.last == i - 1 && (edgeCost(cand.pairs.back().u, u) >= 0.0f || edgeCost(u, cand.pairs.back().u) >= 0.0f)) { o = &cand; break; }
+                    if (!o) { openings.push_back({ {}, i }); o = &openings.back(); }
+                    o->pairs.push_back({ u, v });
+                    o->last = i;
+                }
+            for (size_t k = 0; k < openings.size();) {
+                if (openings[k].last < i) { done.push_back(std::move(openings[k])); openings.erase(openings.begin() + k); }
+                else ++k;
+            }
+        }
+        for (Opening& o : openings) done.push_back(std::move(o));
+        for (const Opening& o : done) {
+            if ((int)o.pairs.size() >= NAV_ENTRANCE_SPLIT) {
+                addTransition(o.pairs.front().u, o.pairs.front().v);
+                addTransition(o.pairs.back().u, o.pairs.back().v);
+            }
+            else {
+                const Pair& p = o.pairs[o.pairs.size() / 2];
+                addTransition(p.u, p.v);
+            }
+        }
+    };
+    for (int cz = 0; cz < cnz; ++cz)
+        for (int cx = 0; cx < cnx; ++cx) {
+            int x0 = cx * NAV_CLUSTER, z0 = cz * NAV_CLUSTER;
+            if (cx + 1 < cnx) scanBorder(x0 + NAV_CLUSTER - 1, z0, 1, 0, 0, 1, NAV_CLUSTER);  // east
+            if (cz + 1 < cnz) scanBorder(x0, z0 + NAV_CLUSTER - 1, 0, 1, 1, 0, NAV_CLUSTER);  // south
+        }
+
+    // transitions by cluster
+    clusterFirst.assign((size_t)cnx * cnz + 1, 0);
+    for (uint32_t n : absNode) clusterFirst[nodeCluster[n] + 1]++;
+    for (size_t c = 0; c + 1 < clusterFirst.size(); ++c) clusterFirst[c + 1] += clusterFirst[c];
+    clusterAbs.resize(absNode.size());
+    {
+        std::vector<uint32_t> fill(clusterFirst.begin(), clusterFirst.end() - 1);
+        for (uint32_t a = 0; a < absNode.size(); ++a) clusterAbs[fill[nodeCluster[absNode[a]]]++] = a;
+    }
+
+    // intra-cluster links: one Dijkstra per transition, inside its cluster
+    std::vector<std::vector<Link>> intra(absNode.size());
+    ParallelFor(absNode.size(), 64, [&](size_t begin, size_t end) {
+        NavScratch s;
+        for (size_t a = begin; a < end; ++a) {
+            uint32_t n = absNode[a], c = nodeCluster[n];
+            SearchCluster(*this, s, n, NAV_NONE, false);
+            for (uint32_t k = clusterFirst[c]; k < clusterFirst[c + 1]; ++k) {
+                uint32_t b = clusterAbs[k];
+                if (b != a && s.Reached(absNode[b])) intra[a].push_back({ (uint32_t)a, b, s.g[absNode[b]] });
+            }
+        }
+        });
+    for (const auto& l : intra) links.insert(links.end(), l.begin(), l.end());
+
+    std::sort(links.begin(), links.end(), [](const Link& x, const Link& y) { return x.from != y.from ? x.from < y.from : x.to < y.to; });
+    absFirst.assign(absNode.size() + 1, 0);
+    for (const Link& l : links) {
+        absFirst[l.from + 1]++;
+        absTo.push_back(l.to);
+        absCost.push_back(l.cost);
+    }
+    for (size_t a = 0; a < absNode.size(); ++a) absFirst[a + 1] += absFirst[a];
+}
+
+// ---------- Path planner ----------
+// Requests are answered from a direct-mapped cache of whole paths keyed by (start, goal) node
+// when possible; the rest queue up and are searched in order, at most 'budget' node
+// expansions per Update (a step in progress may overrun it a little). A search connects the
+// start and goal to their clusters' transitions, runs A* over the abstract graph (the only
+// step that is paused and resumed across Updates), then refines each abstract hop with A*
+// inside one cluster. Failed searches are cached too. Paths are cell centers with straight
+// runs collapsed; the last point is the goal's cell center.
+using NavPath = std::vector<glm::vec2>;
+using NavPathRef = std::shared_ptr<const NavPath>;
+
+const size_t NAV_PATH_CACHE = 8192;  // entries, power of two
+
+struct NavResult { int owner; uint32_t tag; NavPathRef path; };  // path is null when there is none
+
+struct NavStats { uint64_t requests = 0, cacheHits = 0, searches = 0, failed = 0, expanded = 0; };
+
+class NavPlanner {
+public:
+    NavStats stats;
+
+    size_t Pending() const { return queue.size(); }
+
+    void Reset() {
+        queue.clear();
+        cache.assign(NAV_PATH_CACHE, CacheEntry{});
+        active = false;
+        colliderBuild = 0;
+    }
+
+    // True with 'out' set when the cache has the answer (out is null if there is no path);
+    // otherwise the search is queued and its NavResult comes out of a later Update.
+    bool Request(const NavMesh& nav, uint32_t start, uint32_t goal, int owner, uint32_t tag, NavPathRef& out) {
+        Sync(nav);
+        ++stats.requests;
+        if (Cached(start, goal, out)) { ++stats.cacheHits; return true; }
+        queue.push_back({ start, goal, owner, tag });
+        return false;
+    }
+
+    void Update(const NavMesh& nav, int budget, std::vector<NavResult>& done) {
+        Sync(nav);
+        while (budget > 0 && !queue.empty()) {
+            if (!active) {
+                const Query& q = queue.front();
+                NavPathRef path;
+                if (Cached(q.start, q.goal, path)) {  // found by a search queued ahead of it
+                    ++stats.cacheHits;
+                    done.push_back({ q.owner, q.tag, path });
+                    queue.pop_front();
+                    continue;
+                }
+                budget -= Begin(nav);
+            }
+            else {
+                budget -= Step(nav, budget);
+            }
+            if (phase == PHASE_DONE) Finish(nav, done);
+        }
+    }
+
+private:
+    enum Phase { PHASE_ABSTRACT, PHASE_REFINE, PHASE_DONE };
+    struct Query { uint32_t start, goal; int owner; uint32_t tag; };
+    struct CacheEntry { uint32_t start = 0, goal = 0; bool used = false; NavPathRef path; };
+    struct Hop { uint32_t abs; float cost; };
+
+    static size_t Slot(uint32_t start, uint32_t goal) {
+        uint64_t k = ((uint64_t)start << 32 | goal) * 0x9E3779B97F4A7C15ull;
+        return (size_t)(k >> 40) & (NAV_PATH_CACHE - 1);
+    }
+
+    bool Cached(uint32_t start, uint32_t goal, NavPathRef& out) const {
+        const CacheEntry& c = cache[Slot(start, goal)];
+        if (!c.used || c.start != start || c.goal != goal) return false;
+        out = c.path;
+        return true;
+    }
+
+    // A new grid invalidates everything; owners see their requests dropped and ask again.
+    void Sync(const NavMesh& nav) {
+        if (colliderBuild == nav.colliderBuild && cache.size() == NAV_PATH_CACHE) return;
+        Reset();
+        colliderBuild = nav.colliderBuild;
+    }
+
+    int Count(int expanded) { stats.expanded += expanded; return expanded; }
+
+    // Starts the front request: finds the path directly when start and goal share a cluster,
+    // else connects both to their clusters' transitions and seeds the abstract search.
+    int Begin(const NavMesh& nav) {
+        ++stats.searches;
+        active = true;
+        cur = queue.front();
+        nodes.clear();
+        absPath.clear();
+        refineAt = 0;
+        if (cur.start == cur.goal) { nodes.push_back(cur.start); phase = PHASE_DONE; return 1; }
+
+        int used = 0;
+        uint32_t cs = nav.nodeCluster[cur.start], cg = nav.nodeCluster[cur.goal];
+        if (cs == cg) {
+            used += SearchCluster(nav, local, cur.start, cur.goal, false);
+            if (local.Reached(cur.goal)) { nodes = Trace(local, cur.goal); phase = PHASE_DONE; return Count(used); }
+        }
+        startHops.clear();
+        goalHops.clear();
+        used += SearchCluster(nav, local, cur.start, NAV_NONE, false);
+        for (uint32_t k = nav.clusterFirst[cs]; k < nav.clusterFirst[cs + 1]; ++k) {
+            uint32_t a = nav.clusterAbs[k];
+            if (local.Reached(nav.absNode[a])) startHops.push_back({ a, local.g[nav.absNode[a]] });
+        }
+        used += SearchCluster(nav, local, cur.goal, NAV_NONE, true);
+        for (uint32_t k = nav.clusterFirst[cg]; k < nav.clusterFirst[cg + 1]; ++k) {
+            uint32_t a = nav.clusterAbs[k];
+            if (local.Reached(nav.absNode[a])) goalHops.push_back({ a, local.g[nav.absNode[a]] });
+        }
+
+        // abstract nodes, then START and GOAL
+        absStart = (uint32_t)nav.absNode.size();
+        absGoal = absStart + 1;
+        abs.Begin(nav.absNode.size() + 2);
+        abs.Push(absStart, 0.0f, nav.Heuristic(cur.start, cur.goal), NAV_NONE);
+        phase = PHASE_ABSTRACT;
+        return Count(used);
+    }
+
+    uint32_t AbsToNode(const NavMesh& nav, uint32_t a) const {
+        return a == absStart ? cur.start : a == absGoal ? cur.goal : nav.absNode[a];
+    }
+
+    // Advances the current search by up to 'budget' abstract expansions, or by one refined
+    // hop; returns the expansions used.
+    int Step(const NavMesh& nav, int budget) {
+        int used = 0;
+        if (phase == PHASE_ABSTRACT) {
+            while (used < budget) {
+                uint32_t u = abs.Pop();
+                ++used;
+                if (u == NAV_NONE) { phase = PHASE_DONE; break; }  // no path
+                if (u == absGoal) {
+                    for (uint32_t n = absGoal; n != NAV_NONE; n = abs.parent[n]) absPath.push_back(n);
+                    std::reverse(absPath.begin(), absPath.end());
+                    nodes.push_back(cur.start);
+                    phase = PHASE_REFINE;
+                    break;
+                }
+                auto relax = [&](uint32_t v, float c) {
+                    float gv = abs.g[u] + c;
+                    abs.Push(v, gv, gv + nav.Heuristic(AbsToNode(nav, v), cur.goal), u);
+                };
+                if (u == absStart) { for (const Hop& h : startHops) relax(h.abs, h.cost); continue; }
+                for (uint32_t e = nav.absFirst[u]; e < nav.absFirst[u + 1]; ++e) relax(nav.absTo[e], nav.absCost[e]);
+                for (const Hop& h : goalHops) if (h.abs == u) relax(absGoal, h.cost);
+            }
+            return Count(used);
+        }
+        // PHASE_REFINE: hops between clusters are a single edge, hops inside one a local A*
+        uint32_t from = AbsToNode(nav, absPath[refineAt]), to = AbsToNode(nav, absPath[refineAt + 1]);
+        if (from != to && nav.nodeCluster[from] != nav.nodeCluster[to]) {
+            nodes.push_back(to);
+            used = 1;
+        }
+        else if (from != to) {
+            used = SearchCluster(nav, local, from, to, false);
+            std::vector<uint32_t> hop = Trace(local, to);
+            nodes.insert(nodes.end(), hop.begin() + 1, hop.end());
+        }
+        if (++refineAt + 1 >= absPath.size()) phase = PHASE_DONE;
+        return Count(std::max(used, 1));
+    }
+
+    static std::vector<uint32_t> Trace(const NavScratch& s, uint32_t goal) {
+        std::vector<uint32_t> out;
+        for (uint32_t n = goal; n != NAV_NONE; n = s.parent[n]) out.push_back(n);
+        std::reverse(out.begin(), out.end());
+        return out;
+    }
+
+    // Cell centers after the start, keeping only the corners of straight runs.
+    NavPath Simplify(const NavMesh& nav) const {
+        NavPath out;
+        auto step = [&](size_t i) {
+            int a = (int)nav.nodeCell[nodes[i]], b = (int)nav.nodeCell[nodes[i + 1]];
+            return glm::ivec2(b % nav.nx - a % nav.nx, b / nav.nx - a / nav.nx);
+        };
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            if (i + 1 < nodes.size()) {
+                glm::ivec2 s0 = step(i - 1), s1 = step(i);
+                if (s0.x == s1.x && s0.y == s1.y) continue;
+            }
+            out.push_back(nav.NodeXZ(nodes[i]));
+        }
+        if (out.empty()) out.push_back(nav.NodeXZ(cur.goal));
+        return out;
+    }
+
+    void Finish(const NavMesh& nav, std::vector<NavResult>& done) {
+        NavPathRef path;
+        if (!nodes.empty() && nodes.back() == cur.goal) path = std::make_shared<const NavPath>(Simplify(nav));
+        else ++stats.failed;
+        CacheEntry& c = cache[Slot(cur.start, cur.goal)];
+        c.start = cur.start; c.goal = cur.goal; c.used = true; c.path = path;
+        done.push_back({ cur.owner, cur.tag, path });
+        queue.pop_front();
+        active = false;
+    }
+
+    std::deque<Query>       queue;
+    std::vector<CacheEntry> cache;
+    uint32_t                colliderBuild = 0;
+
+    // the search in progress, for the front of the queue
+    bool                  active = false;
+    Query                 cur{};
+    Phase                 phase = PHASE_DONE;
+    NavScratch            local, abs;
+    std::vector<Hop>      startHops, goalHops;
+    uint32_t              absStart = 0, absGoal = 0;
+    std::vector<uint32_t> absPath, nodes;
+    size_t                refineAt = 0;
+};
+
+#endif
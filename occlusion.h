@@ -0,0 +1,184 @@
+// Software occlusion culling: the solid walls found by the wall merge (gOccluders) are drawn
+// into a small CPU depth buffer every frame, reduced to one depth per tile, and bounding boxes
+// are tested against the tiles before their draws are submitted. No GL and no GPU readback,
+// so the answer is for this frame's camera and never waits on the GPU.
+// Header-only: include it from one translation unit per executable.
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "map_collision.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// ---------- Occlusion buffer ----------
+// Depth is 1/w (view distance), which is linear in screen space; larger is nearer and the
+// buffer clears to 0 (infinitely far). Each OCC_TILE x OCC_TILE tile keeps the farthest depth
+// written into it, and a box is occluded when its nearest corner is farther than that in
+// every tile its screen rectangle touches. Boxes that reach the near plane are always visible.
+const int   OCC_WIDTH = 256;        // multiple of OCC_TILE
+const int   OCC_HEIGHT = 144;
+const int   OCC_TILE = 8;
+const int   OCC_TILES_X = OCC_WIDTH / OCC_TILE;
+const int   OCC_TILES_Y = OCC_HEIGHT / OCC_TILE;
+const float OCC_NEAR_W = 0.1f;      // the camera's near plane distance
+
+bool gOcclusionCulling = true;      // F6
+
+class OcclusionBuffer {
+public:
+    int occludersDrawn = 0;         // in the last Render
+    int tested = 0, culled = 0;     // Occluded() calls and hits since the last Render
+
+    OcclusionBuffer() : depth(OCC_WIDTH * OCC_HEIGHT), tileDepth(OCC_TILES_X * OCC_TILES_Y) {}
+
+    // Clears, draws every occluder in front of the camera and builds the tile depths.
+    void Render(const glm::mat4& PV, const std::vector<Occluder>& occluders) {
+        PROFILE_SCOPE(PROF_OCCLUSION);
+        viewProj = PV;
+        occludersDrawn = tested = culled = 0;
+        std::fill(depth.begin(), depth.end(), 0.0f);
+        for (const Occluder& o : occluders)
+            if (DrawQuad(o)) ++occludersDrawn;
+        BuildTiles();
+    }
+
+    bool Occluded(const glm::vec3& bmin, const glm::vec3& bmax) {
+        ++tested;
+        float x0 = 1e30f, y0 = 1e30f, x1 = -1e30f, y1 = -1e30f, nearest = 0.0f;
+        for (int c = 0; c < 8; ++c) {
+            glm::vec4 p = viewProj * glm::vec4(c & 1 ? bmax.x : bmin.x, c & 2 ? bmax.y : bmin.y, c & 4 ? bmax.z : bmin.z, 1.0f);
+            if (p.w < OCC_NEAR_W) return false;
+            float iw = 1.0f / p.w;
+            float sx = (p.x * iw * 0.5f + 0.5f) * OCC_WIDTH, sy = (p.y * iw * 0.5f + 0.5f) * OCC_HEIGHT;
+            x0 = std::min(x0, sx); x1 = std::max(x1, sx);
+            y0 = std::min(y0, sy); y1 = std::max(y1, sy);
+            nearest = std::max(nearest, iw);
+        }
+        int tx0 = std::max(0, (int)std::floor(x0) / OCC_TILE), tx1 = std::min(OCC_TILES_X - 1, (int)std::floor(x1) / OCC_TILE);
+        int ty0 = std::max(0, (int)std::floor(y0) / OCC_TILE), ty1 = std::min(OCC_TILES_Y - 1, (int)std::floor(y1) / OCC_TILE);
+        if (x1 < 0.0f || y1 < 0.0f || tx0 > tx1 || ty0 > ty1) return false;  // off screen: the frustum test's job
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx)
+                if (nearest >= tileDepth[ty * OCC_TILES_X + tx]) return false;
+        ++culled;
+        return true;
+    }
+
+private:
+    struct ScreenVert { float x, y, z; };
+
+    // Clips the quad to the near plane (w >= OCC_NEAR_W) and fans it into triangles.
+    bool DrawQuad(const Occluder& o) {
+        glm::vec4 clip[4];
+        int outL = 0, outR = 0, outB = 0, outT = 0;
+        for (int i = 0; i < 4; ++i) {
+            clip[i] = viewProj * glm::vec4(o.v[i], 1.0f);
+            outL += clip[i].x < -clip[i].w; outR += clip[i].x > clip[i].w;
+            outB += clip[i].y < -clip[i].w; outT += clip[i].y > clip[i].w;
+        }
+        if (outL == 4 || outR == 4 || outB == 4 || outT == 4) return false;
+
+        glm::vec4 poly[8];
+        int n = 0;
+        for (int i = 0; i < 4; ++i) {
+            const glm::vec4& a = clip[i];
+            const glm::vec4& b = clip[(i + 1) % 4];
+            bool aIn = a.w >= OCC_NEAR_W, bIn = b.w >= OCC_NEAR_W;
+            if (aIn) poly[n++] = a;
+            if (aIn != bIn) poly[n++] = glm::mix(a, b, (OCC_NEAR_W - a.w) / (b.w - a.w));
+        }
+        if (n < 3) return false;
+
+        ScreenVert s[8];
+        for (int i = 0; i < n; ++i) {
+            float iw = 1.0f / poly[i].w;
+            s[i] = { (poly[i].x * iw * 0.5f + 0.5f) * OCC_WIDTH, (poly[i].y * iw * 0.5f + 0.5f) * OCC_HEIGHT, iw };
+        }
+        for (int i = 1; i + 1 < n; ++i) DrawTriangle(s[0], s[i], s[i + 1]);
+        return true;
+    }
+
+    // Pixels entirely inside the triangle take max(depth, interpolated 1/w), so an occluder
+    // never covers more than it does on screen. Either winding.
+    void DrawTriangle(ScreenVert a, ScreenVert b, ScreenVert c) {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::fabs(area) < 1e-6f) return;
+        if (area < 0.0f) { std::swap(b, c); area = -area; }
+
+        int minX = std::max(0, (int)std::floor(std::min({ a.x, b.x, c.x })));
+        int maxX = std::min(OCC_WIDTH - 1, (int)std::ceil(std::max({ a.x, b.x, c.x })));
+        int minY = std::max(0, (int)std::floor(std::min({ a.y, b.y, c.y })));
+        int maxY = std::min(OCC_HEIGHT - 1, (int)std::ceil(std::max({ a.y, b.y, c.y })));
+        if (minX > maxX || minY > maxY) return;
+
+        // e_i(x, y) = A_i x + B_i y + C_i, positive inside; depth z(x, y) = zA x + zB y + zC
+        auto edge = [](const ScreenVert& p, const ScreenVert& q, float& A, float& B, float& C) {
+            A = p.y - q.y; B = q.x - p.x; C = p.x * q.y - p.y * q.x;
+        };
+        float A0, B0, C0, A1, B1, C1, A2, B2, C2;
+        edge(b, c, A0, B0, C0);
+        edge(c, a, A1, B1, C1);
+        edge(a, b, A2, B2, C2);
+        float inv = 1.0f / area;
+        float zA = (A0 * a.z + A1 * b.z + A2 * c.z) * inv;
+        float zB = (B0 * a.z + B1 * b.z + B2 * c.z) * inv;
+        float zC = (C0 * a.z + C1 * b.z + C2 * c.z) * inv;
+        // tested at the pixel center: move each edge in by the pixel's half extent along it
+        C0 -= 0.5f * (std::fabs(A0) + std::fabs(B0));
+        C1 -= 0.5f * (std::fabs(A1) + std::fabs(B1));
+        C2 -= 0.5f * (std::fabs(A2) + std::fabs(B2));
+
+#ifdef TRI_SIMD_X86
+        // four pixels per step from a 4-aligned column; OCC_WIDTH is a multiple of 4
+        minX &= ~3;
+        const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), zero = _mm_setzero_ps();
+        for (int y = minY; y <= maxY; ++y) {
+            float py = y + 0.5f;
+            float* row = &depth[y * OCC_WIDTH];
+            for (int x = minX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A0), px), _mm_set1_ps(B0 * py + C0));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A1), px), _mm_set1_ps(B1 * py + C1));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A2), px), _mm_set1_ps(B2 * py + C2));
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+                if (_mm_movemask_ps(inside) == 0) continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(zB * py + zC));
+                // masked-off lanes become 0, which never beats a cleared (0) or written depth
+                _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), _mm_and_ps(inside, z)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; ++y) {
+            float py = y + 0.5f;
+            float* row = &depth[y * OCC_WIDTH];
+            for (int x = minX; x <= maxX; ++x) {
+                float px = x + 0.5f;
+                if (A0 * px + B0 * py + C0 < 0.0f || A1 * px + B1 * py + C1 < 0.0f || A2 * px + B2 * py + C2 < 0.0f) continue;
+                row[x] = std::max(row[x], zA * px + zB * py + zC);
+            }
+        }
+#endif
+    }
+
+    void BuildTiles() {
+        for (int ty = 0; ty < OCC_TILES_Y; ++ty)
+            for (int tx = 0; tx < OCC_TILES_X; ++tx) {
+                float m = depth[ty * OCC_TILE * OCC_WIDTH + tx * OCC_TILE];
+                for (int y = ty * OCC_TILE; y < (ty + 1) * OCC_TILE; ++y) {
+                    const float* row = &depth[y * OCC_WIDTH + tx * OCC_TILE];
+                    for (int x = 0; x < OCC_TILE; ++x) m = std::min(m, row[x]);
+                }
+                tileDepth[ty * OCC_TILES_X + tx] = m;
+            }
+    }
+
+    glm::mat4          viewProj{ 1.0f };
+    std::vector<float> depth;      // OCC_WIDTH x OCC_HEIGHT, row 0 at the bottom of the screen
+    std::vector<float> tileDepth;  // farthest depth per tile
+};
+
+#endif
@@ -0,0 +1,294 @@
+// Frame profiler: scoped CPU timers summed per frame, GPU times reported by the renderer,
+// a rolling summary for the window title, and an optional CSV + Chrome trace capture
+// (load the .json in chrome://tracing or ui.perfetto.dev). No GL in here.
+// Header-only: include it from one translation unit per executable.
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ---------- Zones ----------
+enum ProfZone : int {
+    PROF_INPUT, PROF_LOAD, PROF_COLLIDER, PROF_SIM, PROF_FLOOR, PROF_WALLS, PROF_BULLETS, PROF_NAV,
+    PROF_RENDER, PROF_OCCLUSION, PROF_SWAP, PROF_ZONE_COUNT
+};
+static const char* const PROF_ZONE_NAMES[PROF_ZONE_COUNT] = {
+    "input", "load", "collider", "sim", "floor", "walls", "bullets", "nav", "render", "occlusion", "swap"
+};
+
+enum GpuGroup : int { GPU_MAP, GPU_ACTORS, GPU_CROWD, GPU_BULLETS, GPU_GROUP_COUNT };
+static const char* const GPU_GROUP_NAMES[GPU_GROUP_COUNT] = { "map", "actors", "crowd", "bullets" };
+
+// Per-frame counts (last value set in the frame wins)
+enum ProfCounter : int {
+    PROF_MAP_DRAWN, PROF_MAP_CULLED, PROF_MAP_DRAWS, PROF_CROWD_DRAWN, PROF_PROGRAM_BINDS, PROF_TEXTURE_BINDS,
+    PROF_OCCLUDERS, PROF_OCC_CULLED, PROF_COUNTER_COUNT
+};
+static const char* const PROF_COUNTER_NAMES[PROF_COUNTER_COUNT] = {
+    "map_drawn", "map_culled", "map_draws", "crowd_drawn", "program_binds", "texture_binds",
+    "occluders", "occ_culled"
+};
+
+const int    PROF_HISTORY = 120;                // frames averaged in the summary
+const size_t PROF_TRACE_MAX_EVENTS = 2000000;   // per thread; capture stops adding trace events past this
+
+// The thread that called BindThread() records, and so do pool threads while they run its
+// ParallelFor chunks and JobGraph jobs (ProfJobScope). Anywhere else, e.g. background
+// rebuilds and asset loads, a scope costs one TLS read.
+inline thread_local bool tProfThread = false;
+
+// Lends a job's submitter's recording flag to the thread that runs it.
+struct ProfJobScope {
+    explicit ProfJobScope(bool on) : prev(tProfThread) { tProfThread = on; }
+    ~ProfJobScope() { tProfThread = prev; }
+    ProfJobScope(const ProfJobScope&) = delete;
+    ProfJobScope& operator=(const ProfJobScope&) = delete;
+
+    bool prev;
+};
+
+// ---------- Frame profiler ----------
+class FrameProfiler {
+public:
+    bool enabled = true;
+
+    void BindThread() { tProfThread = true; Local(); }  // registers first, so it is tid 1 next to the frames
+    bool Recording() const { return enabled && tProfThread; }
+
+    uint64_t NowNs() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+    }
+
+    void BeginFrame() {
+        frameStart = NowNs();
+        cur = FrameRecord{};
+        MergeThreads(false);  // anything recorded between frames is dropped
+    }
+
+    void EndFrame() {
+        MergeThreads(true);
+        cur.frameMs = (float)((NowNs() - frameStart) * 1e-6);
+        // GPU results arrive a frame or two late; carry the latest ones into every record
+        for (int g = 0; g < GPU_GROUP_COUNT; ++g) cur.gpu[g] = lastGpu[g];
+        history[frameIndex % PROF_HISTORY] = cur;
+        if (capturing) WriteCaptureFrame();
+        ++frameIndex;
+    }
+
+    // Inclusive time: nested zones are counted in their parent as well. Each thread adds to
+    // its own totals; EndFrame sums them, so a zone run on several threads at once can add up
+    // to more than its parent.
+    void AddCpu(ProfZone z, uint64_t startNs, uint64_t durNs) {
+        ThreadTimes& t = Local();
+        t.ns[z].fetch_add(durNs, std::memory_order_relaxed);
+        if (capturing && t.traceCount++ < PROF_TRACE_MAX_EVENTS) {
+            std::lock_guard<std::mutex> lock(t.mtx);
+            t.trace.push_back({ startNs, durNs, (int)z, t.tid });
+        }
+    }
+
+    void SetGpu(GpuGroup g, double ms) { lastGpu[g] = (float)ms; }
+    void SetCounter(ProfCounter c, int value) { cur.counters[c] = value; }
+
+    // "16.7 ms | cpu sim 0.12 ... | gpu map 1.30 ..." averaged over the last PROF_HISTORY frames
+    std::string Summary() const {
+        int n = (int)std::min<uint64_t>(frameIndex, PROF_HISTORY);
+        if (n == 0) return "";
+        FrameRecord avg{};
+        for (int i = 0; i < n; ++i) {
+            const FrameRecord& r = history[i];
+            avg.frameMs += r.frameMs;
+            for (int z = 0; z < PROF_ZONE_COUNT; ++z) avg.cpu[z] += r.cpu[z];
+            for (int g = 0; g < GPU_GROUP_COUNT; ++g) avg.gpu[g] += r.gpu[g];
+            for (int c = 0; c < PROF_COUNTER_COUNT; ++c) avg.counters[c] += r.counters[c];
+        }
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.2f ms |", avg.frameMs / n);
+        std::string s = buf;
+        s += " cpu";
+        for (int z = 0; z < PROF_ZONE_COUNT; ++z) {
+            std::snprintf(buf, sizeof(buf), " %s %.3f", PROF_ZONE_NAMES[z], avg.cpu[z] / n);
+            s += buf;
+        }
+        s += " | gpu";
+        for (int g = 0; g < GPU_GROUP_COUNT; ++g) {
+            std::snprintf(buf, sizeof(buf), " %s %.2f", GPU_GROUP_NAMES[g], avg.gpu[g] / n);
+            s += buf;
+        }
+        s += " |";
+        for (int c = 0; c < PROF_COUNTER_COUNT; ++c) {
+            std::snprintf(buf, sizeof(buf), " %s %d", PROF_COUNTER_NAMES[c], (int)((avg.counters[c] + n / 2) / n));
+            s += buf;
+        }
+        return s;
+    }
+
+    // Writes <prefix>.csv as frames complete and <prefix>.json (Chrome trace) on StopCapture.
+    bool StartCapture(const std::string& prefix) {
+        StopCapture();
+        csv.open(prefix + ".csv", std::ios::trunc);
+        if (!csv) { std::cout << "[Profiler] cannot write " << prefix << ".csv\n"; return false; }
+        csv << "frame,frame_ms";
+        for (int z = 0; z < PROF_ZONE_COUNT; ++z) csv << ",cpu_" << PROF_ZONE_NAMES[z] << "_ms";
+        for (int g = 0; g < GPU_GROUP_COUNT; ++g) csv << ",gpu_" << GPU_GROUP_NAMES[g] << "_ms";
+        for (int c = 0; c < PROF_COUNTER_COUNT; ++c) csv << ',' << PROF_COUNTER_NAMES[c];
+        csv << "\n";
+        capturePrefix = prefix;
+        trace.clear();
+        frameMarks.clear();
+        {
+            std::lock_guard<std::mutex> lock(threadsMtx);
+            for (const std::unique_ptr<ThreadTimes>& t : threads) t->traceCount = 0;
+        }
+        capturing = true;
+        std::cout << "[Profiler] capturing to " << prefix << ".csv / .json\n";
+        return true;
+    }
+
+    void StopCapture() {
+        if (!capturing) return;
+        capturing = false;
+        csv.close();
+        WriteChromeTrace(capturePrefix + ".json");
+        std::cout << "[Profiler] capture written (" << frameMarks.size() << " frames, " << trace.size() << " events)\n";
+        trace.clear(); trace.shrink_to_fit();
+        frameMarks.clear(); frameMarks.shrink_to_fit();
+    }
+
+    bool Capturing() const { return capturing; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct FrameRecord {
+        float frameMs = 0.0f;
+        float cpu[PROF_ZONE_COUNT] = {};
+        float gpu[GPU_GROUP_COUNT] = {};
+        int64_t counters[PROF_COUNTER_COUNT] = {};
+    };
+    struct TraceEvent { uint64_t startNs, durNs; int zone, tid; };
+
+    // Zone totals and trace events of one recording thread since the last merge. Kept for
+    // the life of the profiler, so a thread that exits loses nothing it recorded.
+    struct ThreadTimes {
+        std::atomic<uint64_t>   ns[PROF_ZONE_COUNT] = {};
+        std::mutex              mtx;
+        std::vector<TraceEvent> trace;
+        size_t                  traceCount = 0;  // events this capture, only touched by the owner
+        int                     tid = 1;
+    };
+
+    ThreadTimes& Local() {
+        thread_local ThreadTimes* t = nullptr;
+        if (!t) {
+            std::lock_guard<std::mutex> lock(threadsMtx);
+            threads.push_back(std::make_unique<ThreadTimes>());
+            t = threads.back().get();
+            t->tid = (int)threads.size();
+        }
+        return *t;
+    }
+
+    // Jobs that record have all finished by the time the frame ends (ParallelFor and
+    // JobGraph::Run wait for them), so nothing is in flight here.
+    void MergeThreads(bool keep) {
+        std::lock_guard<std::mutex> lock(threadsMtx);
+        for (const std::unique_ptr<ThreadTimes>& t : threads) {
+            for (int z = 0; z < PROF_ZONE_COUNT; ++z) {
+                uint64_t ns = t->ns[z].exchange(0, std::memory_order_relaxed);
+                if (keep) cur.cpu[z] += (float)(ns * 1e-6);
+            }
+            std::lock_guard<std::mutex> traceLock(t->mtx);
+            if (keep && capturing) trace.insert(trace.end(), t->trace.begin(), t->trace.end());
+            t->trace.clear();
+        }
+    }
+    struct FrameMark { uint64_t startNs, durNs; float gpu[GPU_GROUP_COUNT]; int64_t counters[PROF_COUNTER_COUNT]; };
+
+    void WriteCaptureFrame() {
+        csv << frameIndex << ',' << cur.frameMs;
+        for (int z = 0; z < PROF_ZONE_COUNT; ++z) csv << ',' << cur.cpu[z];
+        for (int g = 0; g < GPU_GROUP_COUNT; ++g) csv << ',' << cur.gpu[g];
+        for (int c = 0; c < PROF_COUNTER_COUNT; ++c) csv << ',' << cur.counters[c];
+        csv << '\n';
+        FrameMark m{ frameStart, NowNs() - frameStart, {}, {} };
+        std::copy(cur.gpu, cur.gpu + GPU_GROUP_COUNT, m.gpu);
+        std::copy(cur.counters, cur.counters + PROF_COUNTER_COUNT, m.counters);
+        frameMarks.push_back(m);
+    }
+
+    // Complete ("X") events per scope and frame, plus "gpu ms" and "counts" counter tracks.
+    void WriteChromeTrace(const std::string& path) const {
+        std::ofstream f(path, std::ios::trunc);
+        if (!f) { std::cout << "[Profiler] cannot write " << path << "\n"; return; }
+        f << "{\"traceEvents\":[\n";
+        bool first = true;
+        auto sep = [&]() { if (!first) f << ",\n"; first = false; };
+        char buf[256];
+        for (const FrameMark& m : frameMarks) {
+            sep();
+            std::snprintf(buf, sizeof(buf), "{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                          m.startNs * 1e-3, m.durNs * 1e-3);
+            f << buf;
+            sep();
+            f << "{\"name\":\"gpu ms\",\"ph\":\"C\",\"pid\":1,\"ts\":" << m.startNs * 1e-3 << ",\"args\":{";
+            for (int g = 0; g < GPU_GROUP_COUNT; ++g) f << (g ? "," : "") << '"' << GPU_GROUP_NAMES[g] << "\":" << m.gpu[g];
+            f << "}}";
+            sep();
+            f << "{\"name\":\"counts\",\"ph\":\"C\",\"pid\":1,\"ts\":" << m.startNs * 1e-3 << ",\"args\":{";
+            for (int c = 0; c < PROF_COUNTER_COUNT; ++c) f << (c ? "," : "") << '"' << PROF_COUNTER_NAMES[c] << "\":" << m.counters[c];
+            f << "}}";
+        }
+        for (const TraceEvent& e : trace) {
+            sep();
+            std::snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                          PROF_ZONE_NAMES[e.zone], e.tid, e.startNs * 1e-3, e.durNs * 1e-3);
+            f << buf;
+        }
+        f << "\n]}\n";
+    }
+
+    Clock::time_point epoch = Clock::now();
+    uint64_t    frameStart = 0, frameIndex = 0;
+    FrameRecord cur;
+    FrameRecord history[PROF_HISTORY];
+    float       lastGpu[GPU_GROUP_COUNT] = {};
+
+    bool                    capturing = false;
+    std::string             capturePrefix;
+    std::ofstream           csv;
+    std::vector<TraceEvent> trace;
+    std::vector<FrameMark>  frameMarks;
+
+    std::mutex                                threadsMtx;
+    std::vector<std::unique_ptr<ThreadTimes>> threads;  // every thread that has recorded
+};
+
+inline FrameProfiler gProfiler;
+
+struct ProfScope {
+    explicit ProfScope(ProfZone z) : zone(z), on(gProfiler.Recording()) { if (on) start = gProfiler.NowNs(); }
+    ~ProfScope() { if (on) gProfiler.AddCpu(zone, start, gProfiler.NowNs() - start); }
+    ProfScope(const ProfScope&) = delete;
+    ProfScope& operator=(const ProfScope&) = delete;
+
+    ProfZone zone;
+    bool     on;
+    uint64_t start = 0;
+};
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROFILE_SCOPE(zone) ProfScope PROF_CONCAT(profScope_, __LINE__)(zone)
+
+#endif
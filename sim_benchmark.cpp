@@ -0,0 +1,251 @@
+// ===================== Headless gameplay benchmark =====================
+// Loads each map's geometry (through the same .cook cache as the game), builds the
+// colliders and drives scripted input through SimulateTick without a window or GL.
+// Prints collider build stages, per-query costs and p50/p99 tick cost per script.
+//
+// Usage: sim_benchmark [--ticks N] [--heightfield] [--crowd N] [--threads N] [--verify] [map.obj ...]
+//   --crowd sets the enemy count for the scripts that don't pick their own
+//   --threads is the total thread count including the main one (1 = serial); default one per core
+//   --verify checks each map's compact floors, floor BVH and triangle kernels against reference implementations
+//   instead of timing the scripts, and exits non-zero on any mismatch
+//   default map: resources/objects/desert/desert_vill.obj
+
+#include "simulation.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+using BenchClock = std::chrono::steady_clock;
+
+static double MsSince(BenchClock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(BenchClock::now() - t0).count();
+}
+
+// Deterministic so runs are comparable across builds
+struct BenchRng {
+    uint32_t state;
+    float Next() { state = state * 1664525u + 1013904223u; return (state >> 8) * (1.0f / 16777216.0f); }
+};
+
+volatile float gBenchSink;  // keeps timed loops from being optimized away
+
+struct TickStats { double p50 = 0, p99 = 0, max = 0, mean = 0; };
+
+static TickStats Summarize(std::vector<double> ms) {
+    TickStats s;
+    if (ms.empty()) return s;
+    std::sort(ms.begin(), ms.end());
+    auto pct = [&](double p) { return ms[std::min(ms.size() - 1, (size_t)(p * (ms.size() - 1) + 0.5))]; };
+    s.p50 = pct(0.50); s.p99 = pct(0.99); s.max = ms.back();
+    for (double v : ms) s.mean += v;
+    s.mean /= ms.size();
+    return s;
+}
+
+// ---------- Scripted input ----------
+// Each script maps a tick number to the input a player would have produced.
+struct BenchScript {
+    const char* name;
+    InputFrame (*input)(uint32_t tick);
+    int extraBulletsPerTick;  // spawned straight into the pool on top of the player's own shots
+    int enemies;              // 0: use --crowd
+};
+
+static InputFrame WalkCircle(uint32_t tick) {
+    InputFrame in;
+    in.buttons = IN_FORWARD | ((tick / 180) % 2 ? IN_SPRINT : 0);
+    in.yaw = QuantizeYaw(tick * 0.75f);  // a full turn every 8 s
+    return in;
+}
+
+static InputFrame ZigzagJump(uint32_t tick) {
+    InputFrame in;
+    in.buttons = IN_FORWARD | ((tick / 45) % 2 ? IN_LEFT : IN_RIGHT);
+    if (tick % 60 == 0) in.buttons |= IN_JUMP;
+    in.yaw = QuantizeYaw(std::sin(tick * 0.01f) * 120.0f);
+    return in;
+}
+
+static InputFrame RunAndGun(uint32_t tick) {
+    InputFrame in;
+    in.buttons = IN_FORWARD | IN_SPRINT | IN_SHOOT;
+    in.yaw = QuantizeYaw(tick * 2.0f);
+    return in;
+}
+
+static const BenchScript SCRIPTS[] = {
+    { "walk-circle",   WalkCircle, 0,   0 },
+    { "zigzag-jump",   ZigzagJump, 0,   0 },
+    { "run-and-gun",   RunAndGun,  0,   0 },
+    { "bullet-storm",  RunAndGun,  200, 0 },
+    { "crowd-5k",      RunAndGun,  200, 5000 },
+};
+
+// ---------- Stages ----------
+static void ReportColliderBuild(const MapCollisionWorld& w) {
+    std::cout << "  collider build " << w.buildMs << " ms: transform " << w.transformMs
+              << ", walls " << w.wallMs << " (" << w.wallTris << " tris -> " << w.walls.Size() << " boxes)"
+              << ", bvh " << w.bvhMs << ", grid " << w.gridMs << ", free space " << w.freeMs << ", heightfield " << w.hfMs << ", nav " << w.navMs << "\n";
+    std::cout << "  collider memory: floor " << w.bvh.MemoryBytes() / 1024.0 << " KB ("
+              << (double)w.bvh.MemoryBytes() / std::max<size_t>(1, w.bvh.mesh.Size()) << " B/tri, lattice " << w.bvh.mesh.step
+              << "), walls " << (w.walls.MemoryBytes() + w.grid.MemoryBytes()) / 1024.0 << " KB, free space "
+              << w.free.MemoryBytes() / 1024.0 << " KB";
+    if (!w.hf.Empty()) std::cout << ", heightfield " << w.hf.MemoryBytes() / 1024.0 << " KB";
+    std::cout << "\n";
+}
+
+// Average cost of the per-tick queries at random points over the floor bounds.
+static void ReportQueries() {
+    if (gFloorBVH.nodes.empty()) return;
+    const BVHNode& root = gFloorBVH.nodes[0];
+    const int N = 200000;
+    BenchRng rng{ 7 };
+    std::vector<glm::vec3> pts(N);
+    for (auto& p : pts) p = { glm::mix(root.bmin.x, root.bmax.x, rng.Next()), 0.0f, glm::mix(root.bmin.z, root.bmax.z, rng.Next()) };
+
+    std::vector<float> footY(N);
+    auto t0 = BenchClock::now();
+    for (int i = 0; i < N; ++i) footY[i] = SampleFloorYExact(pts[i]);
+    double exactNs = MsSince(t0) * 1e6 / N;
+
+    double hfNs = 0.0;
+    if (!gFloorHF.Empty()) {
+        float sink = 0.0f, y;
+        t0 = BenchClock::now();
+        for (int i = 0; i < N; ++i) sink += gFloorHF.Sample(pts[i].x, pts[i].z, y) ? y : 0.0f;
+        hfNs = MsSince(t0) * 1e6 / N;
+        gBenchSink = sink;
+    }
+
+    int blocked = 0;
+    AABB2D box{ {0, 0}, {0.40f, 0.40f} };
+    t0 = BenchClock::now();
+    for (int i = 0; i < N; ++i) { box.center = { pts[i].x, pts[i].z }; blocked += AnyWallAtHeight(box, footY[i]); }
+    double wallNs = MsSince(t0) * 1e6 / N;
+
+    int moved = 0;
+    FloorQueryCache floor;
+    t0 = BenchClock::now();
+    for (int i = 0; i < N; ++i) {
+        glm::vec3 pos = pts[i];
+        AABB2D b{ {pos.x, pos.z}, {0.40f, 0.40f} };
+        float newFoot;
+        moved += TryMoveWithStepUp(pos, glm::vec3(0.175f, 0.0f, 0.0f), footY[i], b, newFoot, floor);
+    }
+    double moveNs = MsSince(t0) * 1e6 / N;
+
+    // spawn placement: closest spot with room for the player's box, from a point that may be in a wall
+    int found = 0;
+    const int SPAWNS = N / 10;
+    glm::vec3 spot;
+    t0 = BenchClock::now();
+    for (int i = 0; i < SPAWNS; ++i) found += gFreeSpace.FindFree(pts[i].x, pts[i].z, footY[i], 0.40f, SPAWN_SEARCH_DIST, spot);
+    double spawnNs = MsSince(t0) * 1e6 / SPAWNS;
+
+    std::cout << "  queries (ns): SampleFloorY exact " << exactNs;
+    if (!gFloorHF.Empty()) std::cout << ", heightfield " << hfNs;
+    std::cout << ", AnyWallAtHeight " << wallNs << " (" << blocked * 100.0 / N << "% blocked)"
+              << ", TryMoveWithStepUp " << moveNs << " (" << moved * 100.0 / N << "% moved)"
+              << ", FindFree " << spawnNs << " (" << found * 100.0 / SPAWNS << "% found)\n";
+}
+
+// Checks against the brute-force references; returns the number of mismatches. The compact
+// floors are checked against the float triangles they were built from, the BVH and the
+// triangle kernels against scans of the compact floors; the kernels are compared hit for hit
+// and distance for distance with the RaycastTri loop, and timed.
+static size_t VerifyColliders(const std::vector<Tri>& floorSource) {
+    return VerifyFloorLattice(floorSource) + VerifyFloorBVH() + CompareTriKernels(256, true);
+}
+
+static void RunScript(const BenchScript& script, uint32_t ticks, int crowd) {
+    GameState state;
+    gCrowdSize = script.enemies ? script.enemies : crowd;
+    ResetGameState(state);
+    BenchRng rng{ 99 };
+    std::vector<double> tickMs;
+    tickMs.reserve(ticks);
+    size_t peakBullets = 0;
+    long long hits = 0;
+
+    for (uint32_t t = 0; t < ticks; ++t) {
+        InputFrame in = script.input(t);
+        auto t0 = BenchClock::now();
+        for (int b = 0; b < script.extraBulletsPerTick; ++b) {
+            float a = rng.Next() * 6.2831853f;
+            glm::vec3 dir(std::sin(a), (rng.Next() - 0.5f) * 0.2f, -std::cos(a));
+            state.bullets.Spawn(state.playerAbs + glm::vec3(0, 0.5f, 0) + dir * 0.9f, dir * 20.0f, 4.0f, 0.2f);
+        }
+        SimulateTick(state, in, SIM_DT);
+        tickMs.push_back(MsSince(t0));
+        peakBullets = std::max(peakBullets, state.bullets.Live());
+        for (const BulletTarget& tg : state.bulletTargets) hits += tg.hits;
+    }
+
+    TickStats s = Summarize(tickMs);
+    uint64_t floorHits = state.floor.hits + state.enemies.floor.hits;
+    uint64_t floorRays = state.floor.misses + state.enemies.floor.misses;
+    const NavStats& nav = state.nav.stats;
+    std::cout << "  " << std::left << std::setw(13) << script.name << std::right
+              << " p50 " << s.p50 << " ms, p99 " << s.p99 << " ms, max " << s.max << " ms, mean " << s.mean
+              << " ms, enemies " << state.enemies.Size() << ", hits " << hits << ", peak bullets " << peakBullets
+              << ", floor raycasts/tick " << (double)floorRays / ticks << " (" << floorHits * 100.0 / std::max<uint64_t>(1, floorHits + floorRays) << "% cached)"
+              << ", path requests/tick " << (double)nav.requests / ticks << " (" << nav.cacheHits * 100.0 / std::max<uint64_t>(1, nav.requests) << "% cached)"
+              << ", nav expansions/tick " << (double)nav.expanded / ticks
+              << ", state " << std::hex << HashGameState(state) << std::dec << "\n";
+}
+
+int main(int argc, char** argv) {
+    uint32_t ticks = 3600;
+    int crowd = 1, threads = 0;
+    bool verify = false;
+    std::vector<std::string> maps;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ticks" && i + 1 < argc) ticks = (uint32_t)std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--heightfield") gUseHeightfield = true;
+        else if (arg == "--crowd" && i + 1 < argc) crowd = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc) threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--verify") verify = true;
+        else maps.push_back(arg);
+    }
+    if (maps.empty()) maps.push_back("resources/objects/desert/desert_vill.obj");
+
+    gWorkers.Start(ThreadCountFromArg(threads) - 1);
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "[Bench] " << ticks << " ticks per script at " << SIM_HZ << " Hz, heightfield "
+              << (gUseHeightfield ? "on" : "off") << ", tri kernel " << gTriKernel.name
+              << ", threads " << gWorkers.Size() + 1 << "\n";
+
+    int failed = 0;
+    for (const std::string& path : maps) {
+        std::cout << "[Bench] map " << path << "\n";
+        ModelData data;
+        auto t0 = BenchClock::now();
+        if (!LoadModelData(path, true, data)) { std::cout << "  failed to load\n"; ++failed; continue; }
+        std::cout << "  load " << MsSince(t0) << " ms (" << (data.cooked ? "cooked" : "imported") << ")\n";
+        t0 = BenchClock::now();
+        gBenchSink = (float)ClassifyMapLocal(data).floorTris.size();  // cooks skip this at load; timed on its own
+        std::cout << "  classify " << MsSince(t0) << " ms\n";
+
+        gMapLocal = data.collision.Empty() ? ClassifyMapLocal(data) : std::move(data.collision);
+        MapCollisionWorld world = BuildCollisionWorld(gMapLocal, CurrentMapPlacement(), true, verify);
+        ReportColliderBuild(world);
+        InstallCollisionWorld(world);
+
+        if (verify) {
+            if (size_t bad = VerifyColliders(world.floorSource)) { std::cout << "  verify FAILED: " << bad << " mismatches\n"; ++failed; }
+            else std::cout << "  verify ok\n";
+            continue;
+        }
+        ReportQueries();
+        for (const BenchScript& script : SCRIPTS) RunScript(script, ticks, crowd);
+    }
+
+    gWorkers.Stop();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,796 @@
+// Gameplay simulation: fixed-rate tick over GameState (movement, step-up/down, jump,
+// bullets, enemy crowd), per-tick input and its record/replay format. Window-free; the game
+// feeds it SampleInput() and the benchmark feeds it scripted InputFrames.
+// Header-only: include it from one translation unit per executable.
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "map_collision.h"
+#include "navigation.h"
+
+// ---------- Movement ----------
+float gWalkSpeed = 10.5f;
+float gSprintMul = 1.6f;
+
+// ---------- Vertical physics (jump) ----------
+const float GRAVITY = 25.0f;
+const float JUMP_FORCE = 9.5f;
+
+// ---------- Step-up / step-down helpers ----------
+const float STEP_MAX = 1.25f; // max height we can step up
+const float STEP_SNAP_EPS = 0.03f;
+const float STEP_DOWN_MAX = 1.35f;
+
+// Unstick from corners
+const float SKIN = 0.04f;
+const int   UNSTICK_ITER = 4;
+
+// ---------- Simulation rate ----------
+const float SIM_HZ = 60.0f;         // fixed simulation rate; rendering interpolates between ticks
+const float SIM_DT = 1.0f / SIM_HZ;
+const float SIM_MAX_FRAME = 0.25f;  // longer hitches drop time instead of running hundreds of ticks
+
+// ---------- Actors ----------
+float PLAYER_FOOT_BIAS = 1.15f;
+float ENEMY_FOOT_BIAS = 1.15f;
+const float ENEMY_HIT_HEIGHT = 2.5f;  // bullets hit the enemy from its feet up to this height
+const float ENEMY_HALF_EXT = 0.45f;
+const int   ENEMY_HP = 7;
+int gCrowdSize = 1;                   // enemies per session (--crowd N); stored in replays
+
+// ---------- Bullets ----------
+// Fixed-capacity structure-of-arrays pool. Free slots sit on a stack and are reused
+// by Spawn; live slots are kept in a dense list (swap-remove on Kill), so update and
+// draw only touch live bullets and nothing allocates after Init. o* holds the position
+// at the start of the last tick for render interpolation.
+const int BULLET_CAPACITY = 65536;
+
+struct BulletPool {
+    std::vector<float> px, py, pz;
+    std::vector<float> ox, oy, oz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> life, radius;
+    std::vector<int>   freeSlots;  // stack of unused slots
+    std::vector<int>   live;       // dense list of live slots
+    std::vector<int>   livePos;    // slot -> index in 'live', -1 when free
+    std::vector<int>   outcome;    // UpdateBullets scratch, per index in 'live'
+
+    void Init(int capacity) {
+        for (auto* a : { &px, &py, &pz, &ox, &oy, &oz, &vx, &vy, &vz, &life, &radius }) a->assign(capacity, 0.0f);
+        freeSlots.resize(capacity);
+        for (int i = 0; i < capacity; ++i) freeSlots[i] = capacity - 1 - i;  // pop low slots first
+        live.clear(); live.reserve(capacity);
+        livePos.assign(capacity, -1);
+    }
+
+    // Returns the slot, or -1 if the pool is full (the shot is dropped).
+    int Spawn(const glm::vec3& pos, const glm::vec3& vel, float lifeSec, float r) {
+        if (freeSlots.empty()) return -1;
+        int s = freeSlots.back(); freeSlots.pop_back();
+        px[s] = ox[s] = pos.x; py[s] = oy[s] = pos.y; pz[s] = oz[s] = pos.z;
+        vx[s] = vel.x; vy[s] = vel.y; vz[s] = vel.z;
+        life[s] = lifeSec; radius[s] = r;
+        livePos[s] = (int)live.size();
+        live.push_back(s);
+        return s;
+    }
+
+    void Kill(int s) {
+        int i = livePos[s];
+        if (i < 0) return;
+        int last = live.back();
+        live[i] = last; livePos[last] = i;
+        live.pop_back();
+        livePos[s] = -1;
+        freeSlots.push_back(s);
+    }
+
+    glm::vec3 Pos(int s) const { return { px[s], py[s], pz[s] }; }
+    glm::vec3 Lerp(int s, float a) const { return glm::mix(glm::vec3(ox[s], oy[s], oz[s]), Pos(s), a); }
+    size_t Live() const { return live.size(); }
+};
+
+// ---------- Bullet collision ----------
+// Something bullets can hit: an XZ box over a Y range. 'hits' counts bullets that struck it this step.
+struct BulletTarget {
+    AABB2D box;
+    float  minY, maxY;
+    int    hits;
+};
+
+// Slab test of p0 + t*d, t in [0,1], against [bmin, bmax]; tEnter is 0 when p0 starts inside.
+static inline bool SegmentBoxEntry(const glm::vec3& p0, const glm::vec3& d,
+    const glm::vec3& bmin, const glm::vec3& bmax, float& tEnter)
+{
+    float t0 = 0.0f, t1 = 1.0f;
+    for (int a = 0; a < 3; ++a) {
+        if (std::abs(d[a]) < 1e-12f) {
+            if (p0[a] < bmin[a] || p0[a] > bmax[a]) return false;
+            continue;
+        }
+        float inv = 1.0f / d[a];
+        float ta = (bmin[a] - p0[a]) * inv, tb = (bmax[a] - p0[a]) * inv;
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta); t1 = std::min(t1, tb);
+        if (t0 > t1) return false;
+    }
+    tEnter = t0;
+    return true;
+}
+
+// Broadphase for bullets vs targets: a uniform XZ grid rebuilt every step by counting sort
+// on the cell of each target's centre. Queries widen their box by the largest target
+// half-size, so every target sits in exactly one cell and is tested at most once per query.
+const float TARGET_CELL = 2.0f;
+const int   TARGET_GRID_MAX_CELLS = 1 << 20;
+
+struct TargetGrid {
+    void Build(const std::vector<BulletTarget>& targets) {
+        nx = nz = 0;
+        if (targets.empty()) return;
+        glm::vec2 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+        maxHalf = glm::vec2(0.0f);
+        for (const BulletTarget& t : targets) {
+            lo = glm::min(lo, t.box.center); hi = glm::max(hi, t.box.center);
+            maxHalf = glm::max(maxHalf, t.box.halfExt);
+        }
+        cell = TARGET_CELL;
+        while ((double)((hi.x - lo.x) / cell + 1) * ((hi.y - lo.y) / cell + 1) > TARGET_GRID_MAX_CELLS) cell *= 2.0f;
+        origin = lo;
+        nx = (int)((hi.x - lo.x) / cell) + 1;
+        nz = (int)((hi.y - lo.y) / cell) + 1;
+
+        cellStart.assign((size_t)nx * nz + 1, 0);
+        cellOf.resize(targets.size());
+        for (size_t k = 0; k < targets.size(); ++k) {
+            cellOf[k] = CellIndex(targets[k].box.center);
+            cellStart[cellOf[k] + 1]++;
+        }
+        for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+        items.resize(targets.size());
+        fill.assign(cellStart.begin(), cellStart.end() - 1);
+        for (size_t k = 0; k < targets.size(); ++k) items[fill[cellOf[k]]++] = (int)k;
+    }
+
+    // fn(targetIndex) for every target whose centre cell can overlap [lo, hi] on XZ
+    template <class F> void Query(glm::vec2 lo, glm::vec2 hi, F&& fn) const {
+        if (nx == 0) return;
+        lo -= maxHalf; hi += maxHalf;
+        int x0 = std::max(0, (int)std::floor((lo.x - origin.x) / cell)), x1 = std::min(nx - 1, (int)std::floor((hi.x - origin.x) / cell));
+        int z0 = std::max(0, (int)std::floor((lo.y - origin.y) / cell)), z1 = std::min(nz - 1, (int)std::floor((hi.y - origin.y) / cell));
+        for (int cz = z0; cz <= z1; ++cz)
+            for (int cx = x0; cx <= x1; ++cx) {
+                int c = cz * nx + cx;
+                for (int i = cellStart[c]; i < cellStart[c + 1]; ++i) fn(items[i]);
+            }
+    }
+
+private:
+    int CellIndex(glm::vec2 p) const {
+        int cx = glm::clamp((int)((p.x - origin.x) / cell), 0, nx - 1);
+        int cz = glm::clamp((int)((p.y - origin.y) / cell), 0, nz - 1);
+        return cz * nx + cx;
+    }
+
+    float     cell = TARGET_CELL;
+    glm::vec2 origin{ 0.0f }, maxHalf{ 0.0f };
+    int       nx = 0, nz = 0;
+    std::vector<int> cellStart, items, cellOf, fill;
+};
+
+const int    BULLET_MOVED = -1, BULLET_STOPPED = -2;  // UpdateBullets outcomes; >= 0 is a target index
+const size_t BULLET_GRAIN = 256;
+
+// One bullet's step: writes its slot only and returns what happened to it.
+static int StepBullet(BulletPool& pool, int s, float dt, const std::vector<BulletTarget>& targets, const TargetGrid& grid) {
+    glm::vec3 p0 = pool.Pos(s);
+    pool.ox[s] = p0.x; pool.oy[s] = p0.y; pool.oz[s] = p0.z;
+    glm::vec3 d = glm::vec3(pool.vx[s], pool.vy[s], pool.vz[s]) * dt;
+    float r = pool.radius[s];
+
+    pool.life[s] -= dt;
+    if (pool.life[s] <= 0.0f) return BULLET_STOPPED;
+
+    float best = std::numeric_limits<float>::infinity();
+    int   bestTarget = -1;
+    bool  blocked = false;
+    float t;
+
+    glm::vec3 p1 = p0 + d;
+    glm::vec2 segLo = glm::min(glm::vec2(p0.x, p0.z), glm::vec2(p1.x, p1.z)) - glm::vec2(r);
+    glm::vec2 segHi = glm::max(glm::vec2(p0.x, p0.z), glm::vec2(p1.x, p1.z)) + glm::vec2(r);
+    AABB2D sweep{ (segLo + segHi) * 0.5f, (segHi - segLo) * 0.5f };
+
+    grid.Query(segLo, segHi, [&](int k) {
+        const BulletTarget& tg = targets[k];
+        glm::vec3 lo(tg.box.center.x - tg.box.halfExt.x - r, tg.minY - r, tg.box.center.y - tg.box.halfExt.y - r);
+        glm::vec3 hi(tg.box.center.x + tg.box.halfExt.x + r, tg.maxY + r, tg.box.center.y + tg.box.halfExt.y + r);
+        if (SegmentBoxEntry(p0, d, lo, hi, t) && (t < best || (t == best && k < bestTarget))) { best = t; bestTarget = k; }
+        });
+    gWallGrid.QuerySpan(gWalls, sweep, std::min(p0.y, p1.y) - r, std::max(p0.y, p1.y) + r, [&](const WallBox& w) {
+        glm::vec3 lo(w.boxXZ.center.x - w.boxXZ.halfExt.x - r, w.minY - r, w.boxXZ.center.y - w.boxXZ.halfExt.y - r);
+        glm::vec3 hi(w.boxXZ.center.x + w.boxXZ.halfExt.x + r, w.maxY + r, w.boxXZ.center.y + w.boxXZ.halfExt.y + r);
+        if (SegmentBoxEntry(p0, d, lo, hi, t) && t < best) { best = t; bestTarget = -1; blocked = true; }
+        return false;
+        });
+
+    float len = glm::length(d);
+    RayHit fh;
+    if (len > 1e-6f && RaycastFloor(p0, d / len, len, fh) && fh.t / len < best) {
+        best = fh.t / len; bestTarget = -1; blocked = true;
+    }
+
+    if (bestTarget >= 0) return bestTarget;
+    if (blocked) return BULLET_STOPPED;
+    pool.px[s] = p1.x; pool.py[s] = p1.y; pool.pz[s] = p1.z;
+    return BULLET_MOVED;
+}
+
+// Moves every live bullet along its segment for this step and stops it at the first
+// thing the segment touches: a target (counted in its 'hits'), a wall box or the
+// floor. Testing the whole segment means fast bullets can't tunnel through thin
+// walls or targets between frames. 'grid' is rebuilt here from 'targets'.
+// Bullets step in parallel; hits and kills are then applied in one serial pass in the
+// same order at any thread count, so the result doesn't depend on the thread count.
+void UpdateBullets(BulletPool& pool, float dt, std::vector<BulletTarget>& targets, TargetGrid& grid) {
+    PROFILE_SCOPE(PROF_BULLETS);
+    grid.Build(targets);
+    pool.outcome.resize(pool.live.size());
+    ParallelFor(pool.live.size(), BULLET_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) pool.outcome[i] = StepBullet(pool, pool.live[i], dt, targets, grid);
+        });
+    // iterate backwards: Kill swaps the last live slot into the current position
+    for (int i = (int)pool.live.size() - 1; i >= 0; --i) {
+        int o = pool.outcome[i];
+        if (o == BULLET_MOVED) continue;
+        if (o >= 0) targets[o].hits++;
+        pool.Kill(pool.live[i]);
+    }
+}
+
+// ---------- Per-tick input (record / replay) ----------
+// Everything the simulation reads from the player in one tick: a button mask plus the
+// camera yaw quantized to 1/65536 turn. Live play quantizes too, so a recorded session
+// feeds the simulation exactly the same values when it is replayed.
+enum InputButton : uint16_t {
+    IN_FORWARD = 1 << 0, IN_BACK = 1 << 1, IN_LEFT = 1 << 2, IN_RIGHT = 1 << 3,
+    IN_SPRINT = 1 << 4, IN_JUMP = 1 << 5, IN_SHOOT = 1 << 6,
+};
+
+struct InputFrame {
+    uint16_t buttons = 0;
+    int16_t  yaw = 0;
+};
+static_assert(sizeof(InputFrame) == 4, "InputFrame is written to disk as-is");
+
+inline int16_t QuantizeYaw(float deg) {
+    long q = std::lround((double)deg * (65536.0 / 360.0));
+    return (int16_t)(uint16_t)(q & 0xFFFF);
+}
+inline float YawDegrees(int16_t q) { return q * (360.0f / 65536.0f); }
+
+// Replay file: ReplayHeader followed by one InputFrame per tick. The header is
+// rewritten on close with the tick count and a hash of the final game state.
+const char     REPLAY_MAGIC[4] = { 'R','P','L','Y' };
+const uint32_t REPLAY_VERSION = 5;
+const uint32_t REPLAY_HEIGHTFIELD = 1u << 0;
+
+struct ReplayHeader {
+    char     magic[4];
+    uint32_t version;
+    float    tickHz;
+    uint32_t flags;
+    uint32_t ticks;
+    uint32_t enemies;
+    uint64_t finalHash;
+};
+
+class InputRecorder {
+public:
+    bool Open(const std::string& path, uint32_t flags, uint32_t enemies) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) { std::cout << "[Replay] cannot write " << path << "\n"; return false; }
+        std::memcpy(header.magic, REPLAY_MAGIC, 4);
+        header.version = REPLAY_VERSION;
+        header.tickHz = SIM_HZ;
+        header.flags = flags;
+        header.enemies = enemies;
+        file.write((const char*)&header, sizeof(header));
+        std::cout << "[Replay] recording to " << path << "\n";
+        return true;
+    }
+    bool Active() const { return file.is_open(); }
+    void Write(const InputFrame& in) { file.write((const char*)&in, sizeof(in)); header.ticks++; }
+    void Close(uint64_t finalHash) {
+        if (!file.is_open()) return;
+        header.finalHash = finalHash;
+        file.seekp(0);
+        file.write((const char*)&header, sizeof(header));
+        file.close();
+        std::cout << "[Replay] recorded " << header.ticks << " ticks, state hash " << std::hex << finalHash << std::dec << "\n";
+    }
+
+private:
+    std::ofstream file;
+    ReplayHeader  header{};
+};
+
+class InputPlayer {
+public:
+    bool Open(const std::string& path) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f || !f.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, REPLAY_MAGIC, 4) != 0
+            || header.version != REPLAY_VERSION || header.tickHz != SIM_HZ) {
+            std::cout << "[Replay] " << path << " is missing or not a replay for this build\n";
+            return false;
+        }
+        frames.resize(header.ticks);
+        if (header.ticks && !f.read((char*)frames.data(), frames.size() * sizeof(InputFrame))) {
+            std::cout << "[Replay] " << path << " is truncated\n";
+            frames.clear();
+            return false;
+        }
+        active = true;
+        std::cout << "[Replay] playing " << path << " (" << header.ticks << " ticks)\n";
+        return true;
+    }
+    bool Active() const { return active; }
+    uint32_t Flags() const { return header.flags; }
+    uint32_t Enemies() const { return header.enemies; }
+    uint64_t ExpectedHash() const { return header.finalHash; }
+    bool Next(InputFrame& in) {
+        if (cursor >= frames.size()) { active = false; return false; }
+        in = frames[cursor++];
+        return true;
+    }
+
+private:
+    ReplayHeader            header{};
+    std::vector<InputFrame> frames;
+    size_t                  cursor = 0;
+    bool                    active = false;
+};
+
+// ---------- Movement / spawn helpers ----------
+// Move with step-up; fallback to AABB push resolve
+bool TryMoveWithStepUp(glm::vec3& posXZ, const glm::vec3& moveXZ, float currentFootY,
+    AABB2D& playerBox, float& outNewFootY, FloorQueryCache& floor)
+{
+    glm::vec3 candidate = posXZ + moveXZ;
+    AABB2D candBox = playerBox; candBox.center = { candidate.x, candidate.z };
+
+    bool collide = AnyWallAtHeight(candBox, currentFootY);
+
+    if (!collide) { // free move
+        posXZ = candidate; playerBox.center = candBox.center;
+        outNewFootY = currentFootY;
+        return true;
+    }
+
+    // allow step-up if new floor is slightly higher
+    float newFloorY = floor.GetY(candidate);
+    float diff = newFloorY - currentFootY;
+    if (diff > -STEP_SNAP_EPS && diff <= STEP_MAX) {
+        // also make sure at new height we aren't inside walls
+        if (!AnyWallAtHeight(candBox, newFloorY)) {
+            posXZ = candidate; playerBox.center = candBox.center;
+            outNewFootY = newFloorY;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Spawns boxed in by a wall at their foot height move to the closest spot of the free-space
+// grid with room for the box, on the floor layer nearest their height.
+const float SPAWN_SEARCH_DIST = 20.0f;
+
+void NudgeSpawn(glm::vec3& posXZ, AABB2D& box, float& footY) {
+    box.center = { posXZ.x, posXZ.z };
+    if (!AnyWallAtHeight(box, footY)) return;
+
+    glm::vec3 spot;
+    if (!gFreeSpace.FindFree(posXZ.x, posXZ.z, footY, std::max(box.halfExt.x, box.halfExt.y), SPAWN_SEARCH_DIST, spot)) {
+        std::cout << "[Spawn] no free spot near (" << posXZ.x << "," << posXZ.z << ")\n";
+        return;
+    }
+    posXZ.x = spot.x; posXZ.z = spot.z;
+    box.center = { spot.x, spot.z };
+    footY = spot.y;
+    std::cout << "[Spawn] nudged to (" << spot.x << "," << spot.z << ")\n";
+}
+
+// ---------- Navigation ----------
+// The grid follows the installed collider and is built for the enemy's box and the same
+// step limits as the player.
+NavMesh gNavMesh;
+const float NAV_AGENT_HEIGHT = 2.0f;
+const int   NAV_BUDGET = 8192;     // node expansions per tick for queued path searches
+const int   NAV_SNAP_RINGS = 4;    // cells searched around a point that is off the grid
+
+// Runs inside BuildCollisionWorld, on the rebuild worker, from the floors the BVH stores.
+std::shared_ptr<NavMesh> BuildColliderNav(const MapCollisionWorld& w, const std::vector<Tri>& floors) {
+    auto nav = std::make_shared<NavMesh>();
+    nav->Build(floors, w.walls, w.grid, { ENEMY_HALF_EXT, STEP_MAX, STEP_DOWN_MAX, NAV_AGENT_HEIGHT }, w.placement.yOffset);
+    return nav;
+}
+
+// Called by InstallCollisionWorld once gColliderBuild is bumped, so the planner and the crowd
+// drop their paths on the next tick.
+void InstallColliderNav(NavMesh& nav) {
+    std::swap(gNavMesh, nav);
+    gNavMesh.colliderBuild = gColliderBuild;
+}
+
+// In-place height changes only move the grid; new grids come with the collider.
+void UpdateNavMesh() {
+    if (gNavMesh.yOffset != gAppliedPlacement.yOffset) gNavMesh.SetYOffset(gAppliedPlacement.yOffset);
+}
+
+// ---------- Enemy crowd ----------
+// Structure-of-arrays so patrol, floor anchoring and target building are straight loops
+// over a few float arrays. Each enemy patrols between the two points 'range' from home
+// along its direction, walking navigation paths between them (Navigate). Without a
+// navigation grid it walks the straight line instead and turns at the ends (Patrol).
+// Enemy 0 is the original demo enemy.
+const float    CROWD_SPEED_MIN = 0.8f, CROWD_SPEED_MAX = 2.0f;
+const float    CROWD_RANGE_MIN = 2.0f, CROWD_RANGE_MAX = 8.0f;
+const int      CROWD_SPAWN_TRIES = 16;
+const uint32_t CROWD_SEED = 12345u;
+
+struct Crowd {
+    std::vector<float> x, y, z;       // y is the anchored draw height (floor + ENEMY_FOOT_BIAS)
+    std::vector<float> px, py, pz;    // positions at the start of the last tick
+    std::vector<float> vx, vz, speed;
+    std::vector<float> homeX, homeZ, dirX, dirZ, range;
+    std::vector<int>   hp;
+    std::vector<FloorSample> floorSamples;  // Anchor scratch
+    FloorQueryCache    floor;
+
+    // navigation: current path and the next point on it, which patrol end it leads to, and
+    // whether a search is queued; the tag drops answers to requests made before a respawn
+    std::vector<NavPathRef> path;
+    std::vector<uint32_t>   waypoint, pathTag;
+    std::vector<uint8_t>    leg, waiting;   // leg 0: toward home + dir * range, 1: home - dir * range
+    uint32_t                navBuild = 0;
+    std::vector<NavResult>  navDone;        // Navigate scratch
+
+    size_t Size() const { return x.size(); }
+
+    void Clear() {
+        for (auto* a : { &x, &y, &z, &px, &py, &pz, &vx, &vz, &speed, &homeX, &homeZ, &dirX, &dirZ, &range }) a->clear();
+        hp.clear();
+        path.clear(); waypoint.clear(); pathTag.clear(); leg.clear(); waiting.clear();
+        navBuild = 0;
+    }
+
+    void Add(glm::vec2 home, glm::vec2 dir, float spd, float patrolRange) {
+        x.push_back(home.x); y.push_back(0.0f); z.push_back(home.y);
+        px.push_back(home.x); py.push_back(0.0f); pz.push_back(home.y);
+        vx.push_back(dir.x * spd); vz.push_back(dir.y * spd); speed.push_back(spd);
+        homeX.push_back(home.x); homeZ.push_back(home.y); dirX.push_back(dir.x); dirZ.push_back(dir.y);
+        range.push_back(patrolRange);
+        hp.push_back(ENEMY_HP);
+        path.emplace_back(); waypoint.push_back(0); pathTag.push_back(0); leg.push_back(0); waiting.push_back(0);
+    }
+
+    glm::vec2 PatrolEnd(size_t i) const {
+        float s = leg[i] ? -range[i] : range[i];
+        return { homeX[i] + dirX[i] * s, homeZ[i] + dirZ[i] * s };
+    }
+
+    void SavePrevious() { px = x; py = y; pz = z; }
+
+    // Turning flips the velocity, so the offset along the new one is negative and the
+    // enemy can't flip back and forth at the end of its range.
+    void Patrol(float dt) {
+        for (size_t i = 0; i < x.size(); ++i) {
+            x[i] += vx[i] * dt;
+            z[i] += vz[i] * dt;
+            float along = (x[i] - homeX[i]) * vx[i] + (z[i] - homeZ[i]) * vz[i];
+            if (along > range[i] * speed[i]) { vx[i] = -vx[i]; vz[i] = -vz[i]; }
+        }
+    }
+
+    // Finished searches are handed out first; then every enemy without a path asks for one
+    // to its next patrol end (cache hits start walking this tick) and the rest walk their
+    // paths. An enemy that can't get a path turns toward its other end.
+    void Navigate(const NavMesh& nav, NavPlanner& planner, float dt) {
+        if (navBuild != nav.colliderBuild) {  // new grid: paths and queued requests are gone
+            navBuild = nav.colliderBuild;
+            for (size_t i = 0; i < x.size(); ++i) { path[i] = nullptr; waiting[i] = 0; ++pathTag[i]; }
+        }
+        navDone.clear();
+        planner.Update(nav, NAV_BUDGET, navDone);
+        for (const NavResult& r : navDone) {
+            if (r.tag != pathTag[r.owner]) continue;
+            waiting[r.owner] = 0;
+            SetPath(r.owner, r.path);
+        }
+
+        for (size_t i = 0; i < x.size(); ++i) {
+            if (waiting[i]) continue;
+            if (!path[i]) {
+                float foot = y[i] - ENEMY_FOOT_BIAS;
+                glm::vec2 end = PatrolEnd(i);
+                uint32_t from = nav.Nearest(x[i], z[i], foot, NAV_SNAP_RINGS);
+                uint32_t to = nav.Nearest(end.x, end.y, foot, NAV_SNAP_RINGS);
+                NavPathRef p;
+                if (from == NAV_NONE || to == NAV_NONE) { leg[i] ^= 1; continue; }
+                if (!planner.Request(nav, from, to, (int)i, pathTag[i], p)) { waiting[i] = 1; continue; }
+                SetPath(i, p);
+            }
+            float step = speed[i] * dt;
+            while (path[i]) {
+                glm::vec2 wp = (*path[i])[waypoint[i]];
+                float dx = wp.x - x[i], dz = wp.y - z[i];
+                float d = std::sqrt(dx * dx + dz * dz);
+                if (d > step) { x[i] += dx / d * step; z[i] += dz / d * step; break; }
+                x[i] = wp.x; z[i] = wp.y; step -= d;
+                if (++waypoint[i] == path[i]->size()) { path[i] = nullptr; leg[i] ^= 1; }
+            }
+        }
+    }
+
+    void SetPath(size_t i, const NavPathRef& p) {
+        path[i] = p;
+        waypoint[i] = 0;
+        if (!p) leg[i] ^= 1;
+    }
+
+    void Anchor() {
+        floorSamples.resize(x.size());
+        floor.GetBatch(x.data(), z.data(), floorSamples.data(), x.size());
+        for (size_t i = 0; i < x.size(); ++i) y[i] = floorSamples[i].y + ENEMY_FOOT_BIAS;
+    }
+
+    void Respawn(size_t i) {
+        hp[i] = ENEMY_HP; x[i] = homeX[i]; z[i] = homeZ[i];
+        path[i] = nullptr; waiting[i] = 0; leg[i] = 0; ++pathTag[i];
+    }
+
+    glm::vec3 Pos(size_t i) const { return { x[i], y[i], z[i] }; }
+    glm::vec3 Lerp(size_t i, float a) const { return glm::mix(glm::vec3(px[i], py[i], pz[i]), Pos(i), a); }
+};
+
+// Enemy 0 patrols +-6 along x around (-6, 2); the rest get deterministic homes on the floor,
+// with home and both patrol ends clear of walls when a few tries allow it. Clearance comes
+// from the free-space grid on the top floor layer, and a home that is still blocked
+// (enemy 0's included) moves to the closest free spot.
+void SpawnCrowd(Crowd& c, int count) {
+    auto clear = [](glm::vec2 p) { return gFreeSpace.ClearanceAt(p.x, p.y, FREE_TOP) > ENEMY_HALF_EXT; };
+    auto unblock = [&](glm::vec2& p) {
+        glm::vec3 spot;
+        if (!clear(p) && gFreeSpace.FindFree(p.x, p.y, FREE_TOP, ENEMY_HALF_EXT, SPAWN_SEARCH_DIST, spot)) p = { spot.x, spot.z };
+    };
+    c.Clear();
+    glm::vec2 first(-6.0f, 2.0f);
+    unblock(first);
+    c.Add(first, { 1.0f, 0.0f }, 1.2f, 6.0f);
+    if (count <= 1 || gFloorBVH.nodes.empty()) { c.Anchor(); c.SavePrevious(); return; }
+
+    const BVHNode& root = gFloorBVH.nodes[0];
+    uint32_t rng = CROWD_SEED;
+    auto next = [&]() { rng = rng * 1664525u + 1013904223u; return (rng >> 8) * (1.0f / 16777216.0f); };
+    for (int i = 1; i < count; ++i) {
+        glm::vec2 home, dir;
+        float spd = 0.0f, patrol = 0.0f;
+        for (int tries = 0; tries < CROWD_SPAWN_TRIES; ++tries) {
+            home = { glm::mix(root.bmin.x, root.bmax.x, next()), glm::mix(root.bmin.z, root.bmax.z, next()) };
+            float a = next() * 6.2831853f;
+            dir = { std::cos(a), std::sin(a) };
+            spd = glm::mix(CROWD_SPEED_MIN, CROWD_SPEED_MAX, next());
+            patrol = glm::mix(CROWD_RANGE_MIN, CROWD_RANGE_MAX, next());
+            if (clear(home) && clear(home + dir * patrol) && clear(home - dir * patrol)) break;
+        }
+        unblock(home);
+        c.Add(home, dir, spd, patrol);
+    }
+    c.Anchor();
+    c.SavePrevious();
+    std::cout << "[Crowd] " << c.Size() << " enemies\n";
+}
+
+// ---------- Simulation ----------
+// All state advanced by the fixed-rate tick. prev* positions are from the start of the
+// last tick so rendering can interpolate between ticks.
+struct GameState {
+    uint32_t  tick = 0;
+
+    glm::vec3 playerPosXZ{ 0.0f };
+    glm::vec3 playerAbs{ 0.0f }, prevPlayerAbs{ 0.0f };
+    AABB2D    playerBox{ {0.0f, 0.0f}, {0.40f, 0.40f} };
+    float     playerFootY = 0.0f;
+    float     playerYawDeg = 0.0f;
+    float     velY = 0.0f;
+    bool      grounded = false;
+    float     walkSpeed = gWalkSpeed;
+    float     shootCooldown = 0.0f;
+
+    Crowd     enemies;
+
+    glm::vec3 itemPosXZ{ 2.f, 0.f, -4.f };
+    glm::vec3 itemAbs{ 0.0f };
+    AABB2D    itemBox{ {2.f, -4.f}, {0.60f, 0.60f} };
+    bool      itemCollected = false;
+
+    FloorQueryCache           floor;  // player and item queries; the crowd has its own
+    NavPlanner                nav;    // crowd path searches and their cache
+
+    BulletPool                bullets;
+    std::vector<BulletTarget> bulletTargets;  // one per enemy, rebuilt every tick
+    TargetGrid                targetGrid;
+};
+
+// Fresh session; needs the map collider in place.
+void ResetGameState(GameState& s) {
+    s = GameState();
+    s.playerFootY = s.floor.GetY(s.playerPosXZ);
+    // If spawn overlaps walls at this height, nudge to a nearby free spot
+    NudgeSpawn(s.playerPosXZ, s.playerBox, s.playerFootY);
+    float itemFootY = s.floor.GetY(s.itemPosXZ);
+    NudgeSpawn(s.itemPosXZ, s.itemBox, itemFootY);
+    s.playerAbs = s.prevPlayerAbs = { s.playerPosXZ.x, s.playerFootY + PLAYER_FOOT_BIAS, s.playerPosXZ.z };
+    UpdateNavMesh();
+    SpawnCrowd(s.enemies, std::max(1, gCrowdSize));
+    s.bullets.Init(BULLET_CAPACITY);
+}
+
+// Player movement, item pickup and shooting. Touches only player/item state and spawns bullets.
+static void TickPlayer(GameState& s, const InputFrame& in, float dt) {
+    s.prevPlayerAbs = s.playerAbs;
+    s.playerYawDeg = YawDegrees(in.yaw);
+
+    // Walk (camera-relative) with step-up
+    float yaw = glm::radians(s.playerYawDeg);
+    glm::vec3 forward(std::sin(yaw), 0.0f, -std::cos(yaw));
+    glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0, 1, 0)));
+
+    glm::vec3 dir(0.0f);
+    if (in.buttons & IN_FORWARD) dir += forward;
+    if (in.buttons & IN_BACK)    dir -= forward;
+    if (in.buttons & IN_LEFT)    dir -= right;
+    if (in.buttons & IN_RIGHT)   dir += right;
+
+    float speed = s.walkSpeed * ((in.buttons & IN_SPRINT) ? gSprintMul : 1.0f);
+    if (glm::length(dir) > 0.001f) {
+        dir = glm::normalize(dir);
+        glm::vec3 moveXZ = dir * speed * dt;
+
+        float footYCandidate = s.playerFootY;
+        if (!TryMoveWithStepUp(s.playerPosXZ, moveXZ, s.playerFootY, s.playerBox, footYCandidate, s.floor)) {
+            // multi-pass push-out to reduce corner sticking
+            AABB2D tmp = s.playerBox; tmp.center = { s.playerPosXZ.x, s.playerPosXZ.z };
+            for (int it = 0; it < UNSTICK_ITER; ++it) {
+                if (!ResolveWallsAtHeight(tmp, s.playerFootY, s.playerPosXZ)) break;
+            }
+            s.playerBox.center = tmp.center;
+        }
+        else {
+            s.playerFootY = footYCandidate;
+        }
+    }
+
+    // jump
+    if ((in.buttons & IN_JUMP) && s.grounded) { s.velY = JUMP_FORCE; s.grounded = false; }
+
+    // Anchor item to floor
+    {
+        float iy = s.floor.GetY(s.itemPosXZ);
+        s.itemAbs = { s.itemPosXZ.x,  iy + 0.05f,            s.itemPosXZ.z };
+    }
+
+    // Vertical physics
+    s.velY -= GRAVITY * dt;
+    float proposedY = s.playerAbs.y + s.velY * dt;
+
+    float floorY = s.floor.GetY(s.playerPosXZ);
+    float minY = floorY + PLAYER_FOOT_BIAS;
+
+    if (proposedY <= minY) {
+        s.playerAbs.y = minY;
+        s.velY = 0.0f;
+        s.grounded = true;
+        s.playerFootY = floorY;
+    }
+    else {
+        s.playerAbs.y = proposedY;
+        s.grounded = false;
+    }
+    s.playerAbs.x = s.playerPosXZ.x;
+    s.playerAbs.z = s.playerPosXZ.z;
+
+    // Unstick pass (height-aware)
+    {
+        AABB2D b = s.playerBox;
+        b.halfExt.x = std::max(0.01f, b.halfExt.x - SKIN);
+        b.halfExt.y = std::max(0.01f, b.halfExt.y - SKIN);
+
+        for (int it = 0; it < UNSTICK_ITER; ++it) {
+            if (!ResolveWallsAtHeight(b, s.playerFootY, s.playerPosXZ)) break;
+        }
+        s.playerBox.center = b.center;
+        s.playerAbs.x = s.playerPosXZ.x;
+        s.playerAbs.z = s.playerPosXZ.z;
+    }
+
+    // Step-down snap (smooth descent)
+    {
+        float newFloor = s.floor.GetY(s.playerPosXZ);
+        float drop = s.playerFootY - newFloor;
+        if (s.grounded && drop > STEP_SNAP_EPS && drop <= STEP_DOWN_MAX) {
+            s.playerFootY = newFloor;
+            s.playerAbs.y = s.playerFootY + PLAYER_FOOT_BIAS;
+        }
+    }
+
+    // Shooting
+    s.shootCooldown -= dt;
+    if ((in.buttons & IN_SHOOT) && s.shootCooldown <= 0.0f) {
+        s.bullets.Spawn(s.playerAbs + glm::vec3(0, 0.5f, 0) + forward * 0.9f, forward * 20.0f, 4.0f, 0.2f);
+        s.shootCooldown = 0.12f;
+    }
+
+    // Item pickup
+    s.itemBox.center = { s.itemPosXZ.x, s.itemPosXZ.z };
+    if (!s.itemCollected && IntersectsXZ(s.playerBox, s.itemBox)) { s.itemCollected = true; s.walkSpeed = 12.0f; }
+}
+
+// Enemy patrol, then one batched floor lookup for the whole crowd and its bullet targets.
+static void TickCrowd(GameState& s, float dt) {
+    Crowd& e = s.enemies;
+    e.SavePrevious();
+    {
+        PROFILE_SCOPE(PROF_NAV);
+        UpdateNavMesh();
+        if (gNavMesh.Empty()) e.Patrol(dt);
+        else e.Navigate(gNavMesh, s.nav, dt);
+    }
+    e.Anchor();
+    s.bulletTargets.resize(e.Size());
+    for (size_t i = 0; i < e.Size(); ++i) {
+        float foot = e.y[i] - ENEMY_FOOT_BIAS;
+        s.bulletTargets[i] = { { {e.x[i], e.z[i]}, {ENEMY_HALF_EXT, ENEMY_HALF_EXT} }, foot, foot + ENEMY_HIT_HEIGHT, 0 };
+    }
+}
+
+// Bullet hits (swept against the enemies, walls and floor); needs this tick's shots and targets.
+static void TickBullets(GameState& s, float dt) {
+    Crowd& e = s.enemies;
+    UpdateBullets(s.bullets, dt, s.bulletTargets, s.targetGrid);
+    for (size_t i = 0; i < e.Size(); ++i) {
+        if (!s.bulletTargets[i].hits) continue;
+        e.hp[i] -= s.bulletTargets[i].hits;
+        if (e.hp[i] <= 0) e.Respawn(i);
+    }
+}
+
+// The player and the crowd don't read each other's state, so they run side by side;
+// bullets wait for both. Same result at any thread count.
+void SimulateTick(GameState& s, const InputFrame& in, float dt) {
+    JobGraph jobs;
+    JobGraph::Job crowd = jobs.Add([&] { TickCrowd(s, dt); });
+    JobGraph::Job player = jobs.Add([&] { TickPlayer(s, in, dt); });  // added last: the caller picks it up first
+    jobs.Add([&] { TickBullets(s, dt); }, { crowd, player });
+    jobs.Run();
+    s.tick++;
+}
+
+// FNV-1a over the simulated state, used to check that a replay ends where the recording did.
+uint64_t HashGameState(const GameState& s) {
+    uint64_t h = 1469598103934665603ull;
+    auto mix = [&](const void* p, size_t n) {
+        const unsigned char* b = (const unsigned char*)p;
+        for (size_t i = 0; i < n; ++i) { h ^= b[i]; h *= 1099511628211ull; }
+        };
+    mix(&s.tick, sizeof(s.tick));
+    mix(&s.playerAbs, sizeof(s.playerAbs)); mix(&s.playerFootY, sizeof(float)); mix(&s.velY, sizeof(float));
+    const Crowd& e = s.enemies;
+    mix(e.x.data(), e.x.size() * sizeof(float)); mix(e.z.data(), e.z.size() * sizeof(float));
+    mix(e.hp.data(), e.hp.size() * sizeof(int));
+    mix(&s.itemCollected, sizeof(bool)); mix(&s.shootCooldown, sizeof(float));
+    for (int b : s.bullets.live) { glm::vec3 p = s.bullets.Pos(b); mix(&p, sizeof(p)); }
+    return h;
+}
+
+#endif
@@ -0,0 +1,222 @@
+// Worker threads shared by asset loading, collider rebuilds, the simulation tick and the benchmark.
+// Header-only like the rest of the engine code: include it from one translation unit per executable.
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ---------- Worker pool ----------
+// Work-stealing pool. Every worker owns a deque: jobs it submits itself go on the back and
+// it takes from the back (the newest, still-warm job first); jobs from other threads are
+// dealt round-robin; an idle worker steals from the front of the others' deques. Long jobs
+// (texture decode, collider rebuilds) and short per-tick jobs share the same threads, so
+// the per-tick helpers below always let the caller do the work itself if nobody picks it up.
+// GL calls never run here. Start(0) runs every job inline on the submitting thread.
+inline thread_local int tWorkerIndex = -1;  // lane of the current worker thread, -1 elsewhere
+
+class WorkerPool {
+public:
+    ~WorkerPool() { Stop(); }
+
+    void Start(unsigned int threadCount) {
+        Stop();
+        quit = false;
+        for (unsigned int i = 0; i < threadCount; ++i) lanes.push_back(std::make_unique<Lane>());
+        for (unsigned int i = 0; i < threadCount; ++i)
+            threads.emplace_back([this, i] { tWorkerIndex = (int)i; Run((int)i); });
+    }
+
+    void Stop() {
+        { std::lock_guard<std::mutex> lock(sleepMtx); quit = true; }
+        cv.notify_all();
+        for (auto& t : threads) t.join();
+        threads.clear();
+        lanes.clear();
+    }
+
+    size_t Size() const { return threads.size(); }
+
+    template <class F>
+    auto Submit(F&& fn) -> std::future<decltype(fn())> {
+        using R = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        std::future<R> result = task->get_future();
+        if (threads.empty()) { (*task)(); return result; }   // not started: run inline
+        size_t lane = tWorkerIndex >= 0 ? (size_t)tWorkerIndex : nextLane.fetch_add(1) % lanes.size();
+        { std::lock_guard<std::mutex> lock(lanes[lane]->mtx); lanes[lane]->jobs.push_back([task] { (*task)(); }); }
+        { std::lock_guard<std::mutex> lock(sleepMtx); ++pending; }
+        cv.notify_one();
+        return result;
+    }
+
+private:
+    struct Lane {
+        std::mutex mtx;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    bool TakeJob(int self, std::function<void()>& job) {
+        {
+            Lane& own = *lanes[self];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.jobs.empty()) { job = std::move(own.jobs.back()); own.jobs.pop_back(); return true; }
+        }
+        for (size_t k = 1; k < lanes.size(); ++k) {
+            Lane& other = *lanes[(self + k) % lanes.size()];
+            std::lock_guard<std::mutex> lock(other.mtx);
+            if (!other.jobs.empty()) { job = std::move(other.jobs.front()); other.jobs.pop_front(); return true; }
+        }
+        return false;
+    }
+
+    void Run(int self) {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(sleepMtx);
+                cv.wait(lock, [this] { return quit || pending > 0; });
+                if (pending == 0) return;   // quit with nothing left
+                --pending;
+            }
+            // 'pending' counts queued jobs, so one is in some lane; it may be moving
+            // between the push and this search, hence the retry.
+            std::function<void()> job;
+            while (!TakeJob(self, job)) std::this_thread::yield();
+            job();
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::atomic<size_t> nextLane{ 0 };
+    std::mutex sleepMtx;
+    std::condition_variable cv;
+    size_t pending = 0;
+    bool quit = false;
+};
+
+WorkerPool gWorkers;
+
+// Total threads for parallel work (workers plus the caller) from a --threads value; 0 picks
+// one per core. Pass the result minus one to gWorkers.Start.
+inline unsigned int ThreadCountFromArg(int requested) {
+    if (requested > 0) return (unsigned int)requested;
+    return std::max(2u, std::thread::hardware_concurrency());
+}
+
+// ---------- Parallel for ----------
+// Splits [0, n) into at most one chunk per thread (workers plus the caller), each at least
+// 'grain' items, and returns once all are done. Chunks are claimed from a shared counter and
+// the caller claims too, so a worker stuck on a long job (collider rebuild, texture decode)
+// only means the caller does more of the chunks itself; it never waits for a queued task to
+// start. fn(begin, end) must be safe to run concurrently on disjoint ranges.
+template <class F>
+void ParallelFor(size_t n, size_t grain, F&& fn) {
+    size_t chunks = std::min<size_t>(gWorkers.Size() + 1, (n + grain - 1) / std::max<size_t>(grain, 1));
+    if (chunks <= 1) { if (n) fn(size_t(0), n); return; }
+
+    struct Progress { std::atomic<size_t> next{ 0 }, done{ 0 }; };
+    auto progress = std::make_shared<Progress>();
+    size_t per = (n + chunks - 1) / chunks;
+    // Helpers that start after the last chunk was claimed return without touching fn.
+    // They profile like the caller.
+    bool prof = tProfThread;
+    auto run = [progress, &fn, chunks, per, n] {
+        for (size_t c; (c = progress->next.fetch_add(1)) < chunks;) {
+            size_t begin = std::min(n, c * per), end = std::min(n, begin + per);
+            if (begin < end) fn(begin, end);
+            progress->done.fetch_add(1);
+        }
+    };
+    for (size_t i = 1; i < chunks; ++i) gWorkers.Submit([run, prof] { ProfJobScope scope(prof); run(); });
+    run();
+    while (progress->done.load() < chunks) std::this_thread::yield();
+}
+
+// ---------- Job graph ----------
+// A small set of jobs with dependencies, run to completion by Run(). A job becomes ready
+// when everything it depends on has finished. Ready jobs go on a list shared by the caller
+// and helper tasks on the pool, and whoever pops a job runs it, so as with ParallelFor the
+// caller never waits on a busy pool. Rebuild per use; jobs may nest ParallelFor.
+class JobGraph {
+public:
+    using Job = int;
+
+    Job Add(std::function<void()> fn, std::initializer_list<Job> deps = {}) {
+        Job id = (Job)nodes.size();
+        nodes.push_back({ std::move(fn), {}, (int)deps.size() });
+        for (Job d : deps) nodes[d].next.push_back(id);
+        return id;
+    }
+
+    void Run() {
+        if (nodes.empty()) return;
+        auto st = std::make_shared<State>();
+        st->prof = tProfThread;
+        st->nodes = std::move(nodes);
+        nodes.clear();
+        st->remaining = std::make_unique<std::atomic<int>[]>(st->nodes.size());
+        for (size_t i = 0; i < st->nodes.size(); ++i) {
+            st->remaining[i] = st->nodes[i].deps;
+            if (st->nodes[i].deps == 0) st->ready.push_back((Job)i);
+        }
+        for (size_t i = 1; i < st->ready.size(); ++i) SubmitHelper(st);
+        while (st->done.load() < st->nodes.size()) {
+            if (!RunReady(st)) std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Node {
+        std::function<void()> fn;
+        std::vector<Job>      next;
+        int                   deps;
+    };
+    struct State {
+        std::vector<Node>                   nodes;
+        std::unique_ptr<std::atomic<int>[]> remaining;
+        std::mutex                          mtx;
+        std::vector<Job>                    ready;
+        std::atomic<size_t>                 done{ 0 };
+        bool                                prof = false;  // helpers profile like the caller of Run()
+    };
+
+    static void SubmitHelper(const std::shared_ptr<State>& st) {
+        if (gWorkers.Size()) gWorkers.Submit([st] { ProfJobScope scope(st->prof); while (RunReady(st)) {} });
+    }
+
+    // Pops and runs one ready job; false when none is ready right now. After the last
+    // 'done' increment Run() may return, so nothing but 'st' is touched past that point.
+    static bool RunReady(const std::shared_ptr<State>& st) {
+        Job j;
+        {
+            std::lock_guard<std::mutex> lock(st->mtx);
+            if (st->ready.empty()) return false;
+            j = st->ready.back();
+            st->ready.pop_back();
+        }
+        st->nodes[j].fn();
+        int unlocked = 0;
+        for (Job n : st->nodes[j].next) {
+            if (st->remaining[n].fetch_sub(1) != 1) continue;
+            { std::lock_guard<std::mutex> lock(st->mtx); st->ready.push_back(n); }
+            if (unlocked++) SubmitHelper(st);   // this thread takes the first one itself
+        }
+        st->done.fetch_add(1);
+        return true;
+    }
+
+    std::vector<Node> nodes;
+};
+
+#endif